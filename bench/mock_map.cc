@@ -0,0 +1,323 @@
+/// \file
+#include "mock_map.hh"
+#include "map_change_listener.hh"
+#include "openttd_functions.hh"
+
+#include "map_func.h"
+#include "script_accounting.hpp"
+#include "script_error.hpp"
+#include "script_testmode.hpp"
+
+#include <algorithm>
+
+using namespace EmpireAI;
+
+
+uint _map_log_x = 0;
+uint _map_log_y = 0;
+uint _map_size_x = 0;
+uint _map_size_y = 0;
+uint _map_size = 0;
+
+std::vector<MockMap::Tile> MockMap::m_tiles;
+
+
+/// Create a map of clear tiles.
+/**
+ * Caches keyed by the map size are only reset when the size changes, so call notify_all_tiles() once the
+ * new map is ready.
+ * @param[in] log_x Base 2 logarithm of the width of the map.
+ * @param[in] log_y Base 2 logarithm of the height of the map.
+ */
+void MockMap::create(const uint32 log_x, const uint32 log_y)
+{
+    _map_log_x = log_x;
+    _map_log_y = log_y;
+    _map_size_x = 1 << log_x;
+    _map_size_y = 1 << log_y;
+    _map_size = _map_size_x * _map_size_y;
+
+    m_tiles.assign(_map_size, Tile());
+
+    for(TileIndex tile_index = 0; tile_index < _map_size; tile_index++)
+    {
+        if(TileX(tile_index) == 0 || TileY(tile_index) == 0 || TileX(tile_index) == MapMaxX() || TileY(tile_index) == MapMaxY())
+        {
+            m_tiles[tile_index].type = VOID;
+        }
+    }
+}
+
+
+/// Tell every MapChangeListener that every tile has changed.
+void MockMap::notify_all_tiles()
+{
+    for(TileIndex tile_index = 0; tile_index < MapSize(); tile_index++)
+    {
+        MapChangeListener::notify_tile_changed(tile_index);
+    }
+}
+
+
+/// Set every tile of a rectangle, corners included, to the same type. The border of the map is left as it is.
+void MockMap::fill(const uint32 x0, const uint32 y0, const uint32 x1, const uint32 y1, const TileType type)
+{
+    for(uint32 y = std::max(y0, 1u); y <= std::min(y1, MapMaxY() - 1); y++)
+    {
+        for(uint32 x = std::max(x0, 1u); x <= std::min(x1, MapMaxX() - 1); x++)
+        {
+            m_tiles[TileXY(x, y)] = Tile();
+            m_tiles[TileXY(x, y)].type = type;
+        }
+    }
+}
+
+
+/// Get the road bit pointing from a tile towards an adjacent tile, in the order get_road_bits() uses.
+static uint8 road_bit(const TileIndex tile, const TileIndex adjacent_tile)
+{
+    const int32 difference = (int32)(adjacent_tile - tile);
+
+    if(difference == -TileDiffXY(0, 1))
+    {
+        return 1;
+    }
+    if(difference == 1)
+    {
+        return 2;
+    }
+    if(difference == TileDiffXY(0, 1))
+    {
+        return 4;
+    }
+
+    return 8;
+}
+
+
+/// Build a building on a clear tile facing an adjacent tile.
+static bool build_building(const TileIndex tile, const TileIndex front, const MockMap::TileType type)
+{
+    if(tile >= MapSize() || front >= MapSize() || DistanceManhattan(tile, front) != 1 || MockMap::tile(tile).type != MockMap::CLEAR)
+    {
+        ScriptError::last_error = ScriptError::ERR_AREA_NOT_CLEAR;
+        return false;
+    }
+
+    ScriptAccounting::costs += MockMap::BUILDING_COST;
+    ScriptError::last_error = ScriptError::ERR_NONE;
+
+    if(!ScriptTestMode::active)
+    {
+        MockMap::tile(tile).type = type;
+    }
+
+    return true;
+}
+
+
+void EmpireAI::rename_company(std::string /* name */)
+{
+}
+
+
+void EmpireAI::get_money(uint32_t /* amount */)
+{
+}
+
+
+Money EmpireAI::get_bank_balance()
+{
+    return INT64_MAX;
+}
+
+
+void EmpireAI::print_town_name(Town* /* town */)
+{
+}
+
+
+/// Build a straight road. Stations and depots are allowed at either end, where the road stops in front of them.
+bool EmpireAI::issue_build_road(TileIndex start, TileIndex end)
+{
+    if(start == end || start >= MapSize() || end >= MapSize() || (TileX(start) != TileX(end) && TileY(start) != TileY(end)))
+    {
+        ScriptError::last_error = ScriptError::ERR_UNKNOWN;
+        return false;
+    }
+
+    const int32 step = TileX(start) == TileX(end) ? (start < end ? TileDiffXY(0, 1) : -TileDiffXY(0, 1)) : (start < end ? 1 : -1);
+
+    bool already_built = true;
+    Money cost = 0;
+
+    for(TileIndex tile_index = start; ; tile_index += step)
+    {
+        const MockMap::Tile& tile = MockMap::tile(tile_index);
+        const bool at_end = tile_index == start || tile_index == end;
+
+        if(!(at_end && (tile.type == MockMap::STATION || tile.type == MockMap::DEPOT)))
+        {
+            if(tile.type != MockMap::CLEAR && tile.type != MockMap::ROAD)
+            {
+                ScriptError::last_error = ScriptError::ERR_AREA_NOT_CLEAR;
+                return false;
+            }
+
+            const uint8 bits = (tile_index != start ? road_bit(tile_index, tile_index - step) : 0) |
+                               (tile_index != end ? road_bit(tile_index, tile_index + step) : 0);
+
+            if(tile.type == MockMap::CLEAR)
+            {
+                cost += MockMap::ROAD_COST;
+            }
+
+            if(tile.type != MockMap::ROAD || (tile.road_bits & bits) != bits)
+            {
+                already_built = false;
+            }
+        }
+
+        if(tile_index == end)
+        {
+            break;
+        }
+    }
+
+    if(already_built)
+    {
+        ScriptError::last_error = ScriptError::ERR_ALREADY_BUILT;
+        return false;
+    }
+
+    ScriptAccounting::costs += cost;
+    ScriptError::last_error = ScriptError::ERR_NONE;
+
+    if(ScriptTestMode::active)
+    {
+        return true;
+    }
+
+    for(TileIndex tile_index = start; ; tile_index += step)
+    {
+        MockMap::Tile& tile = MockMap::tile(tile_index);
+
+        if(tile.type == MockMap::CLEAR || tile.type == MockMap::ROAD)
+        {
+            tile.type = MockMap::ROAD;
+
+            if(tile_index != start)
+            {
+                tile.road_bits |= road_bit(tile_index, tile_index - step);
+            }
+            if(tile_index != end)
+            {
+                tile.road_bits |= road_bit(tile_index, tile_index + step);
+            }
+        }
+
+        if(tile_index == end)
+        {
+            break;
+        }
+    }
+
+    return true;
+}
+
+
+bool EmpireAI::issue_build_bus_station(TileIndex tile, TileIndex front)
+{
+    return build_building(tile, front, MockMap::STATION);
+}
+
+
+bool EmpireAI::issue_build_road_depot(TileIndex tile, TileIndex front)
+{
+    return build_building(tile, front, MockMap::DEPOT);
+}
+
+
+bool EmpireAI::build_road(TileIndex start, TileIndex end)
+{
+    if(!issue_build_road(start, end))
+    {
+        return false;
+    }
+
+    MapChangeListener::notify_tiles_changed(start, end);
+    return true;
+}
+
+
+bool EmpireAI::build_bus_station(TileIndex tile, TileIndex front)
+{
+    if(!issue_build_bus_station(tile, front))
+    {
+        return false;
+    }
+
+    MapChangeListener::notify_tile_changed(tile);
+    return true;
+}
+
+
+bool EmpireAI::build_road_depot(TileIndex tile, TileIndex front)
+{
+    if(!issue_build_road_depot(tile, front))
+    {
+        return false;
+    }
+
+    MapChangeListener::notify_tile_changed(tile);
+    return true;
+}
+
+
+bool EmpireAI::can_build_road_through(TileIndex tile, TileIndex /* from */, TileIndex /* to */)
+{
+    return tile_supports_road(tile);
+}
+
+
+bool EmpireAI::tile_supports_road(TileIndex tile)
+{
+    return MockMap::tile(tile).type == MockMap::CLEAR || MockMap::tile(tile).type == MockMap::ROAD;
+}
+
+
+bool EmpireAI::tile_is_buildable(TileIndex tile)
+{
+    return tile < MapSize() && MockMap::tile(tile).type == MockMap::CLEAR;
+}
+
+
+uint8 EmpireAI::get_tile_slope(TileIndex /* tile */)
+{
+    return 0;
+}
+
+
+uint8 EmpireAI::get_road_bits(TileIndex tile)
+{
+    return MockMap::tile(tile).road_bits;
+}
+
+
+/// Every tile of the mock map is flat, so a road can connect any two sides of it.
+bool EmpireAI::can_build_connected_road_parts(uint8 slope, uint8 /* road_bits */, int32 /* from_offset */, int32 /* to_offset */)
+{
+    return slope == 0;
+}
+
+
+uint8 EmpireAI::get_house_population(TileIndex tile)
+{
+    return MockMap::tile(tile).type == MockMap::HOUSE ? MockMap::tile(tile).population : 0;
+}
+
+
+TileIndex EmpireAI::get_tile_index(uint32_t x, uint32_t y)
+{
+    return TileXY(x, y);
+}
@@ -0,0 +1,65 @@
+/// \file
+#ifndef MOCK_MAP_HH
+#define MOCK_MAP_HH
+
+
+#include "stdafx.h"
+#include "economy_type.h"
+#include "tile_type.h"
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Synthetic in-memory map for the standalone build.
+     *
+     * Implements the functions of openttd_functions.hh on a plain array of tiles, so that Path, RoadBuilder and
+     * RoadStationBuilder can run without a game. Every tile is flat, and a road can be built on any clear tile or
+     * any tile that already has a road. As in the game, the tiles on the edge of the map can't be built on, so
+     * routes can't wrap around from one side of the map to the other.
+     */
+    class MockMap
+    {
+    public:
+
+        enum TileType : uint8
+        {
+            VOID,  ///< The border of the map, like OpenTTD's MP_VOID tiles.
+            CLEAR,
+            WATER,
+            HOUSE,
+            ROAD,
+            STATION,
+            DEPOT
+        };
+
+        struct Tile
+        {
+            TileType type = CLEAR;
+            uint8 road_bits = 0;
+            uint8 population = 0; ///< Population of a house.
+        };
+
+        static void create(const uint32 log_x, const uint32 log_y);
+        static void notify_all_tiles();
+
+        static Tile& tile(const TileIndex tile_index)
+        {
+            return m_tiles[tile_index];
+        }
+
+        static void fill(const uint32 x0, const uint32 y0, const uint32 x1, const uint32 y1, const TileType type);
+
+        /// Cost of a command, per tile built on
+        static const Money ROAD_COST = 500;
+        static const Money BUILDING_COST = 2000;
+
+    private:
+
+        static std::vector<Tile> m_tiles;
+    };
+}
+
+
+#endif // MOCK_MAP_HH
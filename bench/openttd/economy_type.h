@@ -0,0 +1,12 @@
+/** @file
+ * Stand-in for OpenTTD's economy_type.h.
+ */
+
+#ifndef ECONOMY_TYPE_H
+#define ECONOMY_TYPE_H
+
+#include "stdafx.h"
+
+typedef int64 Money;
+
+#endif // ECONOMY_TYPE_H
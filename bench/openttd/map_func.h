@@ -0,0 +1,54 @@
+/** @file
+ * Stand-in for OpenTTD's map_func.h. The map size is set by MockMap::create().
+ */
+
+#ifndef MAP_FUNC_H
+#define MAP_FUNC_H
+
+#include "stdafx.h"
+#include "tile_type.h"
+
+typedef int32 TileIndexDiff;
+
+extern uint _map_log_x;
+extern uint _map_log_y;
+extern uint _map_size_x;
+extern uint _map_size_y;
+extern uint _map_size;
+
+static inline uint MapLogX() { return _map_log_x; }
+static inline uint MapLogY() { return _map_log_y; }
+static inline uint MapSizeX() { return _map_size_x; }
+static inline uint MapSizeY() { return _map_size_y; }
+static inline uint MapMaxX() { return _map_size_x - 1; }
+static inline uint MapMaxY() { return _map_size_y - 1; }
+static inline uint MapSize() { return _map_size; }
+
+static inline TileIndex TileXY(uint x, uint y)
+{
+	return (y << MapLogX()) + x;
+}
+
+static inline TileIndexDiff TileDiffXY(int x, int y)
+{
+	return (y * (int)MapSizeX()) + x;
+}
+
+static inline uint TileX(TileIndex tile)
+{
+	return tile & MapMaxX();
+}
+
+static inline uint TileY(TileIndex tile)
+{
+	return tile >> MapLogX();
+}
+
+static inline uint DistanceManhattan(TileIndex t0, TileIndex t1)
+{
+	const int dx = (int)TileX(t0) - (int)TileX(t1);
+	const int dy = (int)TileY(t0) - (int)TileY(t1);
+	return std::abs(dx) + std::abs(dy);
+}
+
+#endif // MAP_FUNC_H
@@ -0,0 +1,42 @@
+/** @file
+ * Stand-in for OpenTTD's ScriptAccounting. MockMap adds the cost of every command it runs to costs.
+ */
+
+#ifndef SCRIPT_ACCOUNTING_HPP
+#define SCRIPT_ACCOUNTING_HPP
+
+#include "economy_type.h"
+
+class ScriptAccounting
+{
+public:
+
+	ScriptAccounting()
+	: m_last_costs(costs)
+	{
+		costs = 0;
+	}
+
+	~ScriptAccounting()
+	{
+		costs = m_last_costs;
+	}
+
+	Money GetCosts()
+	{
+		return costs;
+	}
+
+	void ResetCosts()
+	{
+		costs = 0;
+	}
+
+	static inline Money costs = 0; ///< Costs of the commands run since the last reset.
+
+private:
+
+	Money m_last_costs;
+};
+
+#endif // SCRIPT_ACCOUNTING_HPP
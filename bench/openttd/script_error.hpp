@@ -0,0 +1,28 @@
+/** @file
+ * Stand-in for OpenTTD's ScriptError. MockMap sets the error of every command it runs.
+ */
+
+#ifndef SCRIPT_ERROR_HPP
+#define SCRIPT_ERROR_HPP
+
+class ScriptError
+{
+public:
+
+	enum ErrorMessages
+	{
+		ERR_NONE,
+		ERR_UNKNOWN,
+		ERR_ALREADY_BUILT,
+		ERR_AREA_NOT_CLEAR
+	};
+
+	static ErrorMessages GetLastError()
+	{
+		return last_error;
+	}
+
+	static inline ErrorMessages last_error = ERR_NONE;
+};
+
+#endif // SCRIPT_ERROR_HPP
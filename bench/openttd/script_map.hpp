@@ -0,0 +1,35 @@
+/** @file
+ * Stand-in for OpenTTD's ScriptMap, reading the map size set by MockMap::create().
+ */
+
+#ifndef SCRIPT_MAP_HPP
+#define SCRIPT_MAP_HPP
+
+#include "map_func.h"
+
+class ScriptMap
+{
+public:
+
+	static bool IsValidTile(TileIndex tile)
+	{
+		return tile < MapSize();
+	}
+
+	static TileIndex GetTileIndex(uint32 x, uint32 y)
+	{
+		return TileXY(x, y);
+	}
+
+	static int32 DistanceManhattan(TileIndex tile_from, TileIndex tile_to)
+	{
+		if(!IsValidTile(tile_from) || !IsValidTile(tile_to))
+		{
+			return -1;
+		}
+
+		return ::DistanceManhattan(tile_from, tile_to);
+	}
+};
+
+#endif // SCRIPT_MAP_HPP
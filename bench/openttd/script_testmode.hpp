@@ -0,0 +1,30 @@
+/** @file
+ * Stand-in for OpenTTD's ScriptTestMode. MockMap doesn't change the map while a test mode is active.
+ */
+
+#ifndef SCRIPT_TESTMODE_HPP
+#define SCRIPT_TESTMODE_HPP
+
+class ScriptTestMode
+{
+public:
+
+	ScriptTestMode()
+	: m_last_active(active)
+	{
+		active = true;
+	}
+
+	~ScriptTestMode()
+	{
+		active = m_last_active;
+	}
+
+	static inline bool active = false; ///< True while commands are only tested.
+
+private:
+
+	bool m_last_active;
+};
+
+#endif // SCRIPT_TESTMODE_HPP
@@ -0,0 +1,29 @@
+/** @file
+ * Stand-in for OpenTTD's stdafx.h, with only what the standalone build of the AI needs.
+ */
+
+#ifndef STDAFX_H
+#define STDAFX_H
+
+#include <cassert>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+typedef unsigned char byte;
+typedef unsigned int uint;
+
+typedef uint8_t uint8;
+typedef int8_t int8;
+typedef uint16_t uint16;
+typedef int16_t int16;
+typedef uint32_t uint32;
+typedef int32_t int32;
+typedef uint64_t uint64;
+typedef int64_t int64;
+
+#define lengthof(x) (sizeof(x) / sizeof(x[0]))
+#define lastof(x) (&x[lengthof(x) - 1])
+
+#endif // STDAFX_H
@@ -0,0 +1,14 @@
+/** @file
+ * Stand-in for OpenTTD's tile_type.h.
+ */
+
+#ifndef TILE_TYPE_H
+#define TILE_TYPE_H
+
+#include "stdafx.h"
+
+typedef uint32 TileIndex;
+
+static const TileIndex INVALID_TILE = (TileIndex)-1;
+
+#endif // TILE_TYPE_H
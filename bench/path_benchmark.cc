@@ -0,0 +1,690 @@
+/// \file
+/**
+ * Pathfinder benchmarks on synthetic maps.
+ *
+ * Each case generates a map, then times a search between two tiles on it with every search mode, and reports
+ * the number of nodes expanded per second, the peak heap memory used by the search and the time to the result.
+ * Caches are cleared before every search, so each search starts cold. On the open plain, the road and stations
+ * are also built along the path that was found, with a house put in the way halfway through so that the route
+ * has to be repaired, and the road builder is saved and loaded again while it repairs the route. The "script" mode
+ * repeats the forward search through the Script API. Last, the cost of a yield of a DecisionEngine task is timed.
+ */
+
+#include "mock_map.hh"
+#include "coarse_path.hh"
+#include "landmark_map.hh"
+#include "metrics.hh"
+#include "path.hh"
+#include "passenger_map.hh"
+#include "road_builder.hh"
+#include "road_station_builder.hh"
+#include "save_buffer.hh"
+#include "shared_map_caches.hh"
+#include "task.hh"
+
+#include "map_func.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <random>
+
+using namespace EmpireAI;
+
+
+// Heap use is tracked by replacing the global allocation functions. Every block carries its size in front of it.
+static std::atomic<size_t> g_heap_bytes(0);
+static std::atomic<size_t> g_peak_heap_bytes(0);
+
+static const size_t HEADER_SIZE = alignof(std::max_align_t);
+
+
+void* operator new(size_t size)
+{
+    char* block = (char*)std::malloc(size + HEADER_SIZE);
+
+    if(block == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+
+    *(size_t*)block = size;
+
+    const size_t heap_bytes = g_heap_bytes += size;
+    size_t peak_heap_bytes = g_peak_heap_bytes;
+
+    while(heap_bytes > peak_heap_bytes && !g_peak_heap_bytes.compare_exchange_weak(peak_heap_bytes, heap_bytes))
+    {
+    }
+
+    return block + HEADER_SIZE;
+}
+
+
+void operator delete(void* pointer) noexcept
+{
+    if(pointer == nullptr)
+    {
+        return;
+    }
+
+    char* block = (char*)pointer - HEADER_SIZE;
+    g_heap_bytes -= *(size_t*)block;
+    std::free(block);
+}
+
+
+void operator delete(void* pointer, size_t /* size */) noexcept
+{
+    operator delete(pointer);
+}
+
+
+/**
+ * A map to search on, and the two tiles to connect.
+ */
+struct Case
+{
+    const char* name;
+    uint32 log_size;
+    TileIndex start;
+    TileIndex end;
+};
+
+
+/// Open land with a town of houses next to each end of the route.
+static Case open_plain(const uint32 log_size)
+{
+    const uint32 size = 1 << log_size;
+    MockMap::create(log_size, log_size);
+
+    const uint32 start_x = 16, start_y = 16;
+    const uint32 end_x = size - 17, end_y = size - 17;
+
+    // Houses on one side of each end, leaving the end tiles themselves clear
+    MockMap::fill(start_x - 4, start_y + 2, start_x + 4, start_y + 6, MockMap::HOUSE);
+    MockMap::fill(end_x - 4, end_y - 6, end_x + 4, end_y - 2, MockMap::HOUSE);
+
+    for(TileIndex tile_index = 0; tile_index < MapSize(); tile_index++)
+    {
+        if(MockMap::tile(tile_index).type == MockMap::HOUSE)
+        {
+            MockMap::tile(tile_index).population = 20;
+        }
+    }
+
+    return Case{"plain", log_size, TileXY(start_x, start_y), TileXY(end_x, end_y)};
+}
+
+
+/// Walls of water every 16 tiles with a gap at alternating ends, so the route has to zigzag across the map.
+static Case maze(const uint32 log_size)
+{
+    const uint32 size = 1 << log_size;
+    MockMap::create(log_size, log_size);
+
+    bool gap_at_top = true;
+
+    for(uint32 x = 16; x < size - 16; x += 16)
+    {
+        if(gap_at_top)
+        {
+            MockMap::fill(x, 8, x, size - 2, MockMap::WATER);
+        }
+        else
+        {
+            MockMap::fill(x, 1, x, size - 9, MockMap::WATER);
+        }
+
+        gap_at_top = !gap_at_top;
+    }
+
+    return Case{"maze", log_size, TileXY(4, size / 2), TileXY(size - 5, size / 2)};
+}
+
+
+/// A ring of land in the sea. The ends lie on opposite sides of the ring, so the straight line crosses water.
+static Case island(const uint32 log_size)
+{
+    const uint32 size = 1 << log_size;
+    MockMap::create(log_size, log_size);
+    MockMap::fill(0, 0, size - 1, size - 1, MockMap::WATER);
+
+    const int32 centre = size / 2;
+    const int32 inner_radius = size / 6;
+    const int32 outer_radius = size / 2 - 8;
+
+    for(int32 y = 0; y < (int32)size; y++)
+    {
+        for(int32 x = 0; x < (int32)size; x++)
+        {
+            const int32 distance_squared = (x - centre) * (x - centre) + (y - centre) * (y - centre);
+
+            if(distance_squared >= inner_radius * inner_radius && distance_squared <= outer_radius * outer_radius)
+            {
+                MockMap::tile(TileXY(x, y)).type = MockMap::CLEAR;
+            }
+        }
+    }
+
+    const uint32 ring_middle = (inner_radius + outer_radius) / 2;
+    return Case{"island", log_size, TileXY(centre - ring_middle, centre), TileXY(centre + ring_middle, centre)};
+}
+
+
+/// Land broken up by lakes of all sizes, from one corner of the map to the other.
+static Case lakes(const uint32 log_size)
+{
+    const uint32 size = 1 << log_size;
+    MockMap::create(log_size, log_size);
+
+    // Seeded so that the lakes leave a way through at every size
+    std::mt19937 random(log_size + 3);
+    std::uniform_int_distribution<uint32> coordinate(0, size - 1);
+    std::uniform_int_distribution<uint32> extent(size / 64, size / 8);
+
+    for(uint32 lake = 0; lake < 48; lake++)
+    {
+        const uint32 x = coordinate(random);
+        const uint32 y = coordinate(random);
+        MockMap::fill(x, y, x + extent(random), y + extent(random), MockMap::WATER);
+    }
+
+    const TileIndex start = TileXY(2, 2);
+    const TileIndex end = TileXY(size - 3, size - 3);
+    MockMap::fill(1, 1, 8, 8, MockMap::CLEAR);
+    MockMap::fill(size - 9, size - 9, size - 2, size - 2, MockMap::CLEAR);
+
+    return Case{"lakes", log_size, start, end};
+}
+
+
+/// Open land scattered with small obstacles, from one corner of the map to the other.
+static Case long_route(const uint32 log_size)
+{
+    const uint32 size = 1 << log_size;
+    MockMap::create(log_size, log_size);
+
+    std::mt19937 random(log_size);
+    std::uniform_int_distribution<uint32> coordinate(0, size - 4);
+
+    for(uint32 obstacle = 0; obstacle < MapSize() / 64; obstacle++)
+    {
+        const uint32 x = coordinate(random);
+        const uint32 y = coordinate(random);
+        MockMap::fill(x, y, x + 2, y + 2, MockMap::HOUSE);
+    }
+
+    const TileIndex start = TileXY(2, 2);
+    const TileIndex end = TileXY(size - 3, size - 3);
+    MockMap::tile(start).type = MockMap::CLEAR;
+    MockMap::tile(end).type = MockMap::CLEAR;
+
+    return Case{"long", log_size, start, end};
+}
+
+
+/**
+ * Result of one search.
+ */
+struct Result
+{
+    Path::Status status = Path::IN_PROGRESS;
+    uint32 expanded_node_count = 0;
+    size_t path_length = 0;
+    double seconds = 0;
+    size_t peak_heap_bytes = 0;
+    double landmark_seconds = 0; ///< Time to build the landmark tables, in the "alt" mode.
+    size_t landmark_bytes = 0;
+    size_t saved_bytes = 0;       ///< Size of the search when it was saved, in the "saved" mode.
+};
+
+
+/// Run a search until it has finished, and record its result.
+/**
+ * An ANYTIME search is stopped as soon as its path is within the accepted bound of the shortest.
+ */
+template<class PathType>
+static void finish(PathType& path, Result& result, const double accepted_bound = 1.0)
+{
+    while(result.status == Path::IN_PROGRESS)
+    {
+        result.status = path.find(10000);
+
+        if(result.status == Path::IN_PROGRESS && path.has_route() && path.suboptimality_bound() <= accepted_bound)
+        {
+            path.accept_route();
+            result.status = Path::FOUND;
+        }
+    }
+
+    result.expanded_node_count = path.expanded_node_count();
+    result.path_length = path.length();
+}
+
+
+/// Search for a path, optionally over a coarse corridor first, and measure it.
+/**
+ * The "script" mode is a forward search that reads the map through the Script API instead of directly, for
+ * comparison with the "forward" mode. It doesn't keep its path. The "anytime" mode takes the first path that is
+ * at most 20% longer than the shortest, the way FindPath does, and "anytime-full" improves it to the shortest.
+ * The "alt" mode is a forward search guided by landmark tables, which are built first and timed separately.
+ * The "saved" mode is the "anytime" mode, saved halfway through and loaded again, the way a savegame would.
+ */
+static Result search(const Case& map_case, const char* mode, std::unique_ptr<Path>& path)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Result result;
+
+    std::shared_ptr<const LandmarkTables> landmarks;
+
+    if(std::strcmp(mode, "alt") == 0)
+    {
+        const Clock::time_point landmark_start_time = Clock::now();
+
+        // The map has changed since the last case, so this builds new tables in one go
+        MockMap::notify_all_tiles();
+        LandmarkMap::instance()->refresh(UINT32_MAX);
+        landmarks = LandmarkMap::instance()->tables();
+
+        result.landmark_seconds = std::chrono::duration<double>(Clock::now() - landmark_start_time).count();
+        result.landmark_bytes = landmarks->size_in_bytes();
+    }
+
+    // Start every search with cold caches
+    MockMap::notify_all_tiles();
+
+    const size_t heap_bytes_before = g_heap_bytes;
+    g_peak_heap_bytes = heap_bytes_before;
+
+    const Clock::time_point start_time = Clock::now();
+
+    if(std::strcmp(mode, "corridor") == 0)
+    {
+        CoarsePath coarse_path(map_case.start, map_case.end);
+        Path::Status coarse_status = Path::IN_PROGRESS;
+
+        while(coarse_status == Path::IN_PROGRESS)
+        {
+            coarse_status = coarse_path.find(1000);
+        }
+
+        path.reset(new Path(map_case.start, map_case.end, Path::FORWARD));
+
+        if(coarse_status == Path::FOUND)
+        {
+            path->set_corridor(coarse_path.corridor());
+        }
+    }
+    else if(std::strcmp(mode, "script") == 0)
+    {
+        BasicPath<ScriptMapAccess> script_path(map_case.start, map_case.end, Path::FORWARD);
+        finish(script_path, result);
+
+        result.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+        result.peak_heap_bytes = g_peak_heap_bytes - heap_bytes_before;
+        return result;
+    }
+    else if(std::strcmp(mode, "saved") == 0)
+    {
+        path.reset(new Path(map_case.start, map_case.end, Path::ANYTIME));
+        result.status = path->find(1000);
+
+        SaveWriter writer;
+        path->save(writer);
+        path.reset();
+
+        SaveReader reader(writer.data());
+        path.reset(Path::load(reader, nullptr));
+        result.saved_bytes = writer.data().size();
+
+        finish(*path, result, 1.2);
+
+        result.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+        result.peak_heap_bytes = g_peak_heap_bytes - heap_bytes_before;
+        return result;
+    }
+    else if(std::strncmp(mode, "anytime", 7) == 0)
+    {
+        path.reset(new Path(map_case.start, map_case.end, Path::ANYTIME));
+        finish(*path, result, std::strcmp(mode, "anytime") == 0 ? 1.2 : 1.0);
+
+        result.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+        result.peak_heap_bytes = g_peak_heap_bytes - heap_bytes_before;
+        return result;
+    }
+    else if(std::strcmp(mode, "alt") == 0)
+    {
+        path.reset(new Path(map_case.start, map_case.end, Path::FORWARD));
+        path->set_landmarks(landmarks);
+    }
+    else
+    {
+        path.reset(new Path(map_case.start, map_case.end, std::strcmp(mode, "forward") == 0 ? Path::FORWARD : Path::BIDIRECTIONAL));
+    }
+
+    finish(*path, result);
+
+    result.seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+    result.peak_heap_bytes = g_peak_heap_bytes - heap_bytes_before;
+
+    return result;
+}
+
+
+/// Build the road and the stations along a path, and report the time each took.
+static void build(Path& path)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    Clock::time_point start_time = Clock::now();
+
+    RoadBuilder road_builder(path);
+    bool road_built = road_builder.check_plan();
+
+    // A house goes up in the middle of the route once it has been planned, without the caches being told,
+    // so the road builder has to repair the route around it
+    std::vector<TileIndex> tiles(path.begin(), path.end());
+    const TileIndex blocked_tile = tiles[tiles.size() / 2];
+    MockMap::fill(TileX(blocked_tile), TileY(blocked_tile), TileX(blocked_tile), TileY(blocked_tile), MockMap::HOUSE);
+
+    RoadBuilder::Status status = RoadBuilder::IN_PROGRESS;
+    std::unique_ptr<RoadBuilder> loaded_road_builder;
+    size_t saved_bytes = 0;
+
+    while(road_built && status == RoadBuilder::IN_PROGRESS)
+    {
+        RoadBuilder& current_road_builder = loaded_road_builder ? *loaded_road_builder : road_builder;
+        status = current_road_builder.build_road_segment();
+
+        // Save the road builder as soon as it starts repairing the route, and carry on with the loaded one
+        if(status == RoadBuilder::IN_PROGRESS && current_road_builder.repair_count() > 0 && !loaded_road_builder)
+        {
+            SaveWriter writer;
+            road_builder.save(writer);
+            saved_bytes = writer.data().size();
+
+            SaveReader reader(writer.data());
+            loaded_road_builder.reset(new RoadBuilder(path));
+            road_built = loaded_road_builder->load(reader);
+        }
+    }
+
+    road_built = road_built && status == RoadBuilder::BUILT;
+
+    const double road_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    start_time = Clock::now();
+
+    PassengerMap::instance()->refresh(MapSize());
+    RoadStationBuilder road_station_builder(path);
+    const bool stations_built = road_station_builder.build_bus_stations();
+
+    const double station_seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    const uint32 repair_count = loaded_road_builder ? loaded_road_builder->repair_count() : road_builder.repair_count();
+
+    std::printf("    road %s in %.3f ms with %u repairs, resumed from a save of %zu bytes, stations %s in %.3f ms\n",
+        road_built ? "built" : "failed", road_seconds * 1000, repair_count, saved_bytes, stations_built ? "built" : "failed",
+        station_seconds * 1000);
+}
+
+
+/// Add the tiles of a straight line to a route that ends at the first tile of the line.
+static void extend_route(std::vector<TileIndex>& route, const TileIndex end)
+{
+    const TileIndex start = route.back();
+    const int32 distance_x = (int32)TileX(end) - (int32)TileX(start);
+    const int32 distance_y = (int32)TileY(end) - (int32)TileY(start);
+    const int32 step = TileDiffXY((distance_x > 0) - (distance_x < 0), (distance_y > 0) - (distance_y < 0));
+
+    for(TileIndex tile = start; tile != end; )
+    {
+        tile += step;
+        route.push_back(tile);
+    }
+}
+
+
+/// Build a road along a route, returning the status the road builder ends with.
+static RoadBuilder::Status build_route(const std::vector<TileIndex>& route)
+{
+    // Paths are built from their end tile, so the route is given to the path the other way round
+    Path path(route.back(), route.front());
+    path.set_route(std::vector<TileIndex>(route.rbegin(), route.rend()));
+
+    RoadBuilder road_builder(path);
+
+    if(!road_builder.check_plan())
+    {
+        return RoadBuilder::FAILED;
+    }
+
+    RoadBuilder::Status status = RoadBuilder::IN_PROGRESS;
+
+    while(status == RoadBuilder::IN_PROGRESS)
+    {
+        status = road_builder.build_road_segment();
+    }
+
+    return status;
+}
+
+
+/// Build a road from a to b, then one from a to c whose first run lies on the road to b, and report both.
+static void build_overlapping_roads()
+{
+    open_plain(8);
+
+    const TileIndex a = TileXY(40, 40);
+    const TileIndex b = TileXY(80, 40);
+    const TileIndex c = TileXY(60, 80);
+
+    std::vector<TileIndex> first_route(1, a);
+    extend_route(first_route, b);
+
+    std::vector<TileIndex> second_route(1, a);
+    extend_route(second_route, TileXY(60, 40));
+    extend_route(second_route, c);
+
+    const RoadBuilder::Status first_status = build_route(first_route);
+    const RoadBuilder::Status second_status = build_route(second_route);
+
+    std::printf("overlapping roads: first %s, second %s\n", first_status == RoadBuilder::BUILT ? "built" : "failed",
+        second_status == RoadBuilder::BUILT ? "built" : "failed");
+}
+
+
+/// Build a road along a route that a house has gone up on since it was found, and report how it was repaired.
+static void build_blocked_road()
+{
+    open_plain(8);
+
+    std::vector<TileIndex> route(1, TileXY(40, 100));
+    extend_route(route, TileXY(80, 100));
+
+    // The house is there before the plan is checked, so the check finds the run it is on can't be built
+    MockMap::fill(60, 100, 60, 100, MockMap::HOUSE);
+
+    Path path(route.back(), route.front());
+    path.set_route(std::vector<TileIndex>(route.rbegin(), route.rend()));
+
+    RoadBuilder road_builder(path);
+    RoadBuilder::Status status = road_builder.check_plan() ? RoadBuilder::IN_PROGRESS : RoadBuilder::FAILED;
+
+    while(status == RoadBuilder::IN_PROGRESS)
+    {
+        status = road_builder.build_road_segment();
+    }
+
+    // The path follows the repaired route, which has a road all along only if the runs before the house were built
+    bool connected = true;
+
+    for(const TileIndex tile : path)
+    {
+        connected = connected && MockMap::tile(tile).type == MockMap::ROAD;
+    }
+
+    std::printf("blocked road: %s, %u repairs, %s\n", status == RoadBuilder::BUILT ? "built" : "failed",
+        road_builder.repair_count(), connected ? "connected" : "not connected");
+}
+
+
+/// Where a yielding task carries on, stored the way DecisionEngine stores it for each route.
+static std::coroutine_handle<> g_resume_point;
+
+
+/// Stands in for DecisionEngine::next_step(), which is private to it.
+class YieldAwaiter
+{
+public:
+
+    bool await_ready() const noexcept
+    {
+        return false;
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) noexcept
+    {
+        g_resume_point = handle;
+    }
+
+    void await_resume() const noexcept {}
+};
+
+
+/// Yield a number of times from a nested task, the way a stage of a DecisionEngine route yields.
+static Task<uint32> yielding_stage(const uint32 yield_count)
+{
+    for(uint32 index = 0; index < yield_count; index++)
+    {
+        co_await YieldAwaiter();
+    }
+
+    co_return yield_count;
+}
+
+
+static Task<> yielding_route(const uint32 yield_count, uint32& yielded)
+{
+    yielded = co_await yielding_stage(yield_count);
+}
+
+
+/// Time how long a task takes to yield and be resumed, and how much memory its coroutines take.
+static void time_yields()
+{
+    typedef std::chrono::steady_clock Clock;
+
+    const uint32 yield_count = 10000000;
+    uint32 yielded = 0;
+
+    const size_t heap_bytes_before = g_heap_bytes;
+    Task<> task = yielding_route(yield_count, yielded);
+    g_resume_point = task.handle();
+    g_resume_point.resume();
+    const size_t frame_bytes = g_heap_bytes - heap_bytes_before;
+
+    const Clock::time_point start_time = Clock::now();
+
+    while(!task.done())
+    {
+        g_resume_point.resume();
+    }
+
+    const double seconds = std::chrono::duration<double>(Clock::now() - start_time).count();
+
+    std::printf("task yields: %u in %.3f ms, %.1f ns each, %zu bytes of coroutine frames\n", yielded, seconds * 1000,
+        seconds * 1e9 / yield_count, frame_bytes);
+}
+
+
+int main(int argc, char* argv[])
+{
+    // With --metrics, everything the searches and builders record is written as JSON at the end
+    const bool write_metrics = argc > 1 && std::strcmp(argv[1], "--metrics") == 0;
+
+    Metrics metrics;
+    Metrics::Scope metrics_scope(&metrics);
+
+    // Held the way each AI holds it, so that the caches are freed once the benchmarks are done
+    std::shared_ptr<SharedMapCaches> map_caches = SharedMapCaches::acquire();
+
+    typedef Case (*Generator)(const uint32 log_size);
+
+    struct Benchmark
+    {
+        Generator generator;
+        std::vector<uint32> log_sizes;
+    };
+
+    const Benchmark benchmarks[] = {
+        {open_plain, {8, 9, 10}},
+        {maze, {8, 9, 10}},
+        {island, {8, 9, 10}},
+        {lakes, {9, 10}},
+        {long_route, {10, 11}}
+    };
+
+    const char* modes[] = {"forward", "script", "bidirectional", "corridor", "anytime", "anytime-full", "alt", "saved"};
+
+    std::printf("%-8s %6s %-14s %-11s %10s %8s %10s %12s %10s\n", "case", "size", "mode", "status", "expanded", "length",
+        "time ms", "nodes/sec", "peak KiB");
+
+    for(const Benchmark& benchmark : benchmarks)
+    {
+        for(const uint32 log_size : benchmark.log_sizes)
+        {
+            const Case map_case = benchmark.generator(log_size);
+
+            for(const char* mode : modes)
+            {
+                std::unique_ptr<Path> path;
+                const Result result = search(map_case, mode, path);
+
+                const char* status = result.status == Path::FOUND ? "found" : "unreachable";
+                const double nodes_per_second = result.seconds > 0 ? result.expanded_node_count / result.seconds : 0;
+
+                std::printf("%-8s %6u %-14s %-11s %10u %8zu %10.3f %12.0f %10zu\n", map_case.name, 1 << log_size, mode,
+                    status, result.expanded_node_count, result.path_length, result.seconds * 1000, nodes_per_second,
+                    result.peak_heap_bytes / 1024);
+
+                if(result.landmark_bytes > 0)
+                {
+                    std::printf("    landmarks built in %.3f ms, %zu KiB\n", result.landmark_seconds * 1000,
+                        result.landmark_bytes / 1024);
+                }
+
+                if(result.saved_bytes > 0)
+                {
+                    std::printf("    saved after 1000 nodes in %zu KiB\n", result.saved_bytes / 1024);
+                }
+
+                if(result.status == Path::FOUND && std::strcmp(map_case.name, "plain") == 0 && std::strcmp(mode, "corridor") == 0)
+                {
+                    build(*path);
+                }
+            }
+        }
+    }
+
+    build_overlapping_roads();
+    build_blocked_road();
+    time_yields();
+
+    const size_t heap_bytes_before_release = g_heap_bytes;
+    map_caches.reset();
+
+    std::printf("shared map caches freed %zu KiB\n", (heap_bytes_before_release - g_heap_bytes) / 1024);
+
+    if(write_metrics)
+    {
+        metrics.write_json(std::cout);
+    }
+
+    return 0;
+}
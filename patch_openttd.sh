@@ -4,6 +4,7 @@
 patch --directory='..' < ./patch/ai_core.cpp.patch
 patch --directory='..' < ./patch/CMakeLists.txt.patch
 patch --directory='../../script/api/' < ./patch/script_object.hpp.patch
+patch --directory='../../saveload/' < ./patch/ai_sl.cpp.patch
 
 # Build openTTD
 pwd
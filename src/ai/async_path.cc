@@ -0,0 +1,222 @@
+/// \file
+#include "async_path.hh"
+#include "landmark_map.hh"
+#include "openttd_functions.hh"
+
+#include <chrono>
+
+using namespace EmpireAI;
+
+
+/// Construct a new asynchronous pathfinder.
+/**
+ * The search runs forward only. A coarse route through the corridor is already known to exist, so a bidirectional
+ * search has no cut-off end to detect early, and it expands about twice as many nodes before its frontiers meet.
+ * @param[in] start The tile at the start of the path to find.
+ * @param[in] end The tile at the end of the path to find.
+ * @param[in] corridor The clusters the search is allowed to enter. Only these are captured in the snapshot.
+ */
+AsyncPath::AsyncPath(const TileIndex start, const TileIndex end, const Corridor& corridor)
+: AsyncPath(corridor)
+{
+    m_path.reset(new SnapshotPath(start, end, Path::FORWARD, SnapshotMapAccess(m_snapshot)));
+    m_path->set_corridor(corridor);
+    m_path->set_landmarks(LandmarkMap::instance()->tables());
+}
+
+
+/// Construct an asynchronous pathfinder without a search, for load() to read one into.
+AsyncPath::AsyncPath(const Corridor& corridor)
+: m_snapshot(corridor), m_cancelled(false), m_metrics(nullptr), m_status(Path::IN_PROGRESS)
+{
+}
+
+
+/// Stop the worker, if it is still searching, before the path and snapshot it uses are destroyed.
+AsyncPath::~AsyncPath()
+{
+    stop_worker();
+}
+
+
+/// Start the search from a known route as well. See Path::seed_route(). Must be called before the first call to find().
+void AsyncPath::seed_route(const std::vector<TileIndex>& route)
+{
+    m_path->seed_route(route);
+}
+
+
+/// Advance the search. Must be called repeatedly on the game thread until it returns FOUND or UNREACHABLE.
+/**
+ * A route that no longer fits the live map is reported as UNREACHABLE, just like a route that doesn't exist,
+ * so that the caller falls back to searching the live map.
+ * @return The status of the pathfinder.
+ */
+Path::Status AsyncPath::find()
+{
+    if(m_status != Path::IN_PROGRESS)
+    {
+        return m_status;
+    }
+
+    if(!m_snapshot.complete())
+    {
+        if(m_snapshot.capture(TILES_PER_FIND))
+        {
+            m_metrics = Metrics::active();
+            start_worker();
+        }
+
+        return m_status;
+    }
+
+    if(m_search.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+    {
+        return m_status;
+    }
+
+    m_status = m_search.get();
+
+    if(m_status == Path::FOUND && !route_is_valid())
+    {
+        m_status = Path::UNREACHABLE;
+    }
+
+    return m_status;
+}
+
+
+/// Hand the finished path over to the caller, who becomes responsible for deleting it.
+/**
+ * The snapshot goes away with this object, so the route is handed over in a Path that reads the live map.
+ * Only call this once find() has returned FOUND.
+ */
+Path* AsyncPath::release_path()
+{
+    // The route runs from the end tile back to the start tile
+    const std::vector<TileIndex> route(m_path->begin(), m_path->end());
+
+    Path* path = new Path(route.back(), route.front());
+    path->set_route(std::vector<TileIndex>(route.rbegin(), route.rend()));
+
+    m_path.reset();
+    return path;
+}
+
+
+/// Write the search, so that loading it carries on where it stopped instead of searching again.
+/**
+ * A worker that is searching is stopped between two steps while the search is written, and started again afterwards.
+ * The snapshot isn't written, since the map is read again on loading.
+ * @param[out] writer The writer to append the search to.
+ */
+void AsyncPath::save(SaveWriter& writer)
+{
+    const bool searching = m_search.valid();
+
+    stop_worker();
+
+    corridor().save(writer);
+    m_path->save(writer);
+
+    // A search that finished during its last step returns its status again straight away
+    if(searching)
+    {
+        start_worker();
+    }
+}
+
+
+/// Create a search from the data written by save(), carrying on where the saved search stopped.
+/**
+ * The snapshot is captured again from the live map over the next calls of find(), and the worker then carries on
+ * with the saved nodes.
+ * @param[in] reader The reader to read the search from.
+ * @return The search, or nullptr if the data was invalid.
+ */
+AsyncPath* AsyncPath::load(SaveReader& reader)
+{
+    Corridor corridor;
+    corridor.load(reader);
+
+    if(reader.failed())
+    {
+        return nullptr;
+    }
+
+    std::unique_ptr<AsyncPath> async_path(new AsyncPath(corridor));
+    async_path->m_path.reset(SnapshotPath::load(reader, LandmarkMap::instance()->tables(),
+        SnapshotMapAccess(async_path->m_snapshot)));
+
+    if(async_path->m_path == nullptr)
+    {
+        return nullptr;
+    }
+
+    // A search that has finished doesn't write its corridor, which is written first for the snapshot anyway
+    async_path->m_path->set_corridor(corridor);
+
+    return async_path.release();
+}
+
+
+/// Start the worker on the search, which must not be running.
+void AsyncPath::start_worker()
+{
+    m_cancelled = false;
+    m_search = std::async(std::launch::async, &AsyncPath::search, this);
+}
+
+
+/// Stop the worker once it has finished its current step, if it is running. The status it stops with is dropped.
+void AsyncPath::stop_worker()
+{
+    if(m_search.valid())
+    {
+        m_cancelled = true;
+        m_search.wait();
+        m_search = std::future<Path::Status>();
+    }
+}
+
+
+/// Run the whole search. Called on the worker thread.
+Path::Status AsyncPath::search()
+{
+    Metrics::Scope metrics_scope(m_metrics);
+
+    Path::Status status = Path::IN_PROGRESS;
+
+    while(status == Path::IN_PROGRESS && !m_cancelled)
+    {
+        status = m_path->find(NODES_PER_STEP);
+    }
+
+    return status;
+}
+
+
+/// Check that a road can still be built along every tile of the route on the live map.
+/**
+ * The map is read directly, not through the ConnectivityCache, which may not have heard yet of tiles changed by
+ * towns or other companies while the worker was searching.
+ */
+bool AsyncPath::route_is_valid()
+{
+    TileIndex previous_tile = INVALID_TILE;
+    TileIndex current_tile = INVALID_TILE;
+
+    for(SnapshotPath::Iterator iterator = m_path->begin(); iterator != m_path->end(); iterator++)
+    {
+        // Like the search itself, the tiles at either end only have to connect in one direction
+        if(previous_tile != INVALID_TILE && !can_build_road_through(current_tile, previous_tile, *iterator))
+        {
+            return false;
+        }
+
+        previous_tile = current_tile;
+        current_tile = *iterator;
+    }
+
+    return true;
+}
@@ -0,0 +1,92 @@
+/// \file
+#ifndef ASYNC_PATH_HH
+#define ASYNC_PATH_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "corridor.hh"
+#include "map_snapshot.hh"
+#include "metrics.hh"
+#include "path.hh"
+#include <atomic>
+#include <future>
+#include <memory>
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Runs a Path search on a worker thread, so that the game thread only has to poll for the result.
+     *
+     * The tiles of the corridor are first captured into a MapSnapshot on the game thread, spread over several
+     * calls of find(). The search then runs on a worker thread against the snapshot. It reads the map through
+     * SnapshotMapAccess, so it can't reach the caches of the game thread. Since the map can change while the
+     * worker is busy, a route it finds is checked against the live map before it is handed out.
+     *
+     * The search can be saved at any time. The worker is stopped between two steps while the nodes are written, and
+     * a loaded search captures its snapshot again and carries on with the saved nodes.
+     */
+    class AsyncPath
+    {
+    public:
+
+        AsyncPath(const TileIndex start, const TileIndex end, const Corridor& corridor);
+        ~AsyncPath();
+        AsyncPath(const AsyncPath&) = delete;
+        AsyncPath& operator=(const AsyncPath&) = delete;
+
+        void seed_route(const std::vector<TileIndex>& route);
+
+        Path::Status find();
+
+        Path* release_path();
+
+        void save(SaveWriter& writer);
+        static AsyncPath* load(SaveReader& reader);
+
+        /// The corridor the search is confined to. The worker never changes it, so it can be read at any time.
+        const Corridor& corridor() const
+        {
+            return *m_path->corridor();
+        }
+
+        /// Return true while the worker is searching, and the game thread has nothing to do but wait.
+        bool searching() const
+        {
+            return m_search.valid();
+        }
+
+    private:
+
+        /// The search run by the worker, which reads nothing but the snapshot
+        typedef BasicPath<SnapshotMapAccess> SnapshotPath;
+
+        explicit AsyncPath(const Corridor& corridor);
+
+        void start_worker();
+        void stop_worker();
+        Path::Status search();
+        bool route_is_valid();
+
+        /// Capture up to this many tiles of the snapshot per call of find()
+        static const uint32 TILES_PER_FIND = 1024;
+
+        /// Let the worker check for cancellation after this many nodes
+        static const uint16 NODES_PER_STEP = 10000;
+
+        MapSnapshot m_snapshot;
+        std::unique_ptr<SnapshotPath> m_path;
+
+        std::future<Path::Status> m_search; ///< Valid while the worker is searching.
+        std::atomic<bool> m_cancelled;      ///< Tells the worker to stop after its current step.
+
+        Metrics* m_metrics; ///< The metrics active when the worker was first started, for the worker to record into.
+
+        Path::Status m_status;
+    };
+}
+
+
+#endif // ASYNC_PATH_HH
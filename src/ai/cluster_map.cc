@@ -0,0 +1,309 @@
+/// \file
+#include "cluster_map.hh"
+#include "connectivity_cache.hh"
+
+#include "map_func.h"
+
+using namespace EmpireAI;
+
+
+ClusterMap* ClusterMap::m_instance = nullptr;
+
+
+ClusterMap::ClusterMap()
+: m_clusters_per_row(0), m_cluster_rows(0), m_map_size(0)
+{
+}
+
+
+ClusterMap* ClusterMap::instance()
+{
+    if(m_instance == nullptr)
+    {
+        m_instance = new ClusterMap();
+    }
+
+    m_instance->reset_if_map_changed();
+    return m_instance;
+}
+
+
+/// Free the cluster map once no AI needs it any more. The next call to instance() starts an empty one.
+void ClusterMap::destroy()
+{
+    delete m_instance;
+    m_instance = nullptr;
+}
+
+
+/// Get a cluster, building it first if it isn't up to date.
+/**
+ * @param[in] cluster_index Index of the cluster, as returned by Corridor::cluster_index().
+ * @return The cluster.
+ */
+const ClusterMap::Cluster& ClusterMap::cluster(const uint32 cluster_index)
+{
+    if(!m_clusters[cluster_index].valid)
+    {
+        build_cluster(cluster_index);
+    }
+
+    return m_clusters[cluster_index];
+}
+
+
+/// Find the road distance from a tile to every other tile of its cluster, without leaving the cluster.
+/**
+ * Tiles are connected with the same rules as Path uses, so the distances are the lengths Path would find
+ * if it was confined to this cluster.
+ * @param[in] source The tile to measure distances from.
+ * @param[out] distances Distance to each tile of the cluster, indexed by local_index(). -1 for unreachable tiles.
+ * @param[in] targets If set, only the distances to these entrances are needed, and the search stops once it has
+ *                    reached all of them. Other tiles may be left at -1 even if they are reachable.
+ */
+void ClusterMap::distances_in_cluster(const TileIndex source, std::vector<int32>& distances, const std::vector<Entrance>* targets)
+{
+    const TileIndex origin = TileXY(TileX(source) & ~CLUSTER_MASK, TileY(source) & ~CLUSTER_MASK);
+
+    distances.assign(CLUSTER_SIZE * CLUSTER_SIZE, -1);
+    m_previous_tiles.assign(CLUSTER_SIZE * CLUSTER_SIZE, INVALID_TILE);
+    m_queue.clear();
+    m_queue.reserve(CLUSTER_SIZE * CLUSTER_SIZE);
+
+    // A tile on the corner of a cluster can be an entrance on two edges, so count each target tile once
+    uint32 remaining_target_count = UINT32_MAX;
+
+    if(targets != nullptr)
+    {
+        m_targets.assign(CLUSTER_SIZE * CLUSTER_SIZE, false);
+        remaining_target_count = 0;
+
+        for(const Entrance& target : *targets)
+        {
+            if(!m_targets[local_index(target.tile_index)])
+            {
+                m_targets[local_index(target.tile_index)] = true;
+                remaining_target_count++;
+            }
+        }
+    }
+
+    distances[local_index(source)] = 0;
+    m_queue.push_back(local_index(source));
+
+    if(targets != nullptr && m_targets[local_index(source)])
+    {
+        remaining_target_count--;
+    }
+
+    static const int32 offsets[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+
+    ConnectivityCache* connectivity = ConnectivityCache::instance();
+
+    // Breadth first, since every step along a road costs the same
+    for(size_t head = 0; head < m_queue.size() && remaining_target_count > 0; head++)
+    {
+        const uint32 index = m_queue[head];
+        const int32 x = index & CLUSTER_MASK;
+        const int32 y = index >> CLUSTER_BITS;
+        const TileIndex tile = origin + TileDiffXY(x, y);
+
+        for(const auto& offset : offsets)
+        {
+            const int32 adjacent_x = x + offset[0];
+            const int32 adjacent_y = y + offset[1];
+
+            if(adjacent_x < 0 || adjacent_y < 0 || adjacent_x >= (int32)CLUSTER_SIZE || adjacent_y >= (int32)CLUSTER_SIZE)
+            {
+                continue;
+            }
+
+            const uint32 adjacent_index = (adjacent_y << CLUSTER_BITS) | adjacent_x;
+
+            if(distances[adjacent_index] != -1)
+            {
+                continue;
+            }
+
+            const TileIndex adjacent_tile = origin + TileDiffXY(adjacent_x, adjacent_y);
+
+            if(m_previous_tiles[index] != INVALID_TILE && !connectivity->can_build_road_through(tile, m_previous_tiles[index], adjacent_tile))
+            {
+                continue;
+            }
+
+            distances[adjacent_index] = distances[index] + 1;
+            m_previous_tiles[adjacent_index] = tile;
+            m_queue.push_back(adjacent_index);
+
+            if(targets != nullptr && m_targets[adjacent_index])
+            {
+                remaining_target_count--;
+            }
+        }
+    }
+}
+
+
+/// Mark the clusters containing a changed tile as out of date.
+/**
+ * Entrances depend on the tiles on both sides of a cluster edge, so a tile on an edge also invalidates the
+ * neighbouring cluster.
+ * @param[in] tile The tile that changed.
+ */
+void ClusterMap::tile_changed(TileIndex tile)
+{
+    if(m_clusters.empty() || tile >= m_map_size)
+    {
+        return;
+    }
+
+    const int32 cluster_x = TileX(tile) >> CLUSTER_BITS;
+    const int32 cluster_y = TileY(tile) >> CLUSTER_BITS;
+    const uint32 local_x = TileX(tile) & CLUSTER_MASK;
+    const uint32 local_y = TileY(tile) & CLUSTER_MASK;
+
+    invalidate_cluster(cluster_x, cluster_y);
+
+    if(local_x == 0)
+    {
+        invalidate_cluster(cluster_x - 1, cluster_y);
+    }
+    if(local_x == CLUSTER_MASK)
+    {
+        invalidate_cluster(cluster_x + 1, cluster_y);
+    }
+    if(local_y == 0)
+    {
+        invalidate_cluster(cluster_x, cluster_y - 1);
+    }
+    if(local_y == CLUSTER_MASK)
+    {
+        invalidate_cluster(cluster_x, cluster_y + 1);
+    }
+}
+
+
+/// Discard all clusters if a game with a different map size has been started.
+void ClusterMap::reset_if_map_changed()
+{
+    if(m_map_size == MapSize() && m_clusters_per_row == (MapSizeX() >> CLUSTER_BITS))
+    {
+        return;
+    }
+
+    m_map_size = MapSize();
+    m_clusters_per_row = MapSizeX() >> CLUSTER_BITS;
+    m_cluster_rows = MapSizeY() >> CLUSTER_BITS;
+
+    m_clusters.clear();
+    m_clusters.resize(m_clusters_per_row * m_cluster_rows);
+}
+
+
+void ClusterMap::invalidate_cluster(const int32 cluster_x, const int32 cluster_y)
+{
+    if(cluster_x < 0 || cluster_y < 0 || cluster_x >= (int32)m_clusters_per_row || cluster_y >= (int32)m_cluster_rows)
+    {
+        return;
+    }
+
+    Cluster& cluster = m_clusters[cluster_y * m_clusters_per_row + cluster_x];
+    cluster.valid = false;
+    cluster.entrances.clear();
+}
+
+
+/// Find the entrances of a cluster and the road distances between them.
+/**
+ * @param[in] cluster_index Index of the cluster to build.
+ */
+void ClusterMap::build_cluster(const uint32 cluster_index)
+{
+    Cluster& cluster = m_clusters[cluster_index];
+    cluster.entrances.clear();
+
+    const uint32 cluster_x = cluster_index % m_clusters_per_row;
+    const uint32 cluster_y = cluster_index / m_clusters_per_row;
+    const TileIndex origin = TileXY(cluster_x << CLUSTER_BITS, cluster_y << CLUSTER_BITS);
+    const int32 row = TileDiffXY(0, 1);
+    const int32 last = CLUSTER_SIZE - 1;
+
+    // Scan each edge that has a neighbouring cluster on the other side
+    if(cluster_y > 0)
+    {
+        find_entrances(origin, 1, -row, cluster.entrances);
+    }
+    if(cluster_y + 1 < m_cluster_rows)
+    {
+        find_entrances(origin + TileDiffXY(0, last), 1, row, cluster.entrances);
+    }
+    if(cluster_x > 0)
+    {
+        find_entrances(origin, row, -1, cluster.entrances);
+    }
+    if(cluster_x + 1 < m_clusters_per_row)
+    {
+        find_entrances(origin + TileDiffXY(last, 0), row, 1, cluster.entrances);
+    }
+
+    // Connect every entrance to the others it can reach inside the cluster
+    std::vector<int32> distances;
+
+    for(Entrance& entrance : cluster.entrances)
+    {
+        distances_in_cluster(entrance.tile_index, distances, &cluster.entrances);
+
+        for(uint32 other_index = 0; other_index < cluster.entrances.size(); other_index++)
+        {
+            int32 distance = distances[local_index(cluster.entrances[other_index].tile_index)];
+
+            if(distance > 0)
+            {
+                entrance.edges.push_back({other_index, distance});
+            }
+        }
+    }
+
+    cluster.valid = true;
+}
+
+
+/// Find the entrances along one edge of a cluster.
+/**
+ * An entrance is placed in the middle of every unbroken stretch of edge where both the tile inside the cluster
+ * and the tile across the edge could carry a road. The neighbouring cluster scans the same pairs of tiles from
+ * its side, so both clusters always agree on where their shared entrances are.
+ * @param[in] first_tile The first tile of the edge, inside the cluster.
+ * @param[in] step Offset from one tile of the edge to the next.
+ * @param[in] exit_offset Offset from a tile of the edge to the tile across the edge.
+ * @param[out] entrances The entrances found are added to this list.
+ */
+void ClusterMap::find_entrances(const TileIndex first_tile, const int32 step, const int32 exit_offset, std::vector<Entrance>& entrances)
+{
+    ConnectivityCache* connectivity = ConnectivityCache::instance();
+
+    int32 run_start = -1;
+
+    for(int32 position = 0; position <= (int32)CLUSTER_SIZE; position++)
+    {
+        bool crossable = false;
+
+        if(position < (int32)CLUSTER_SIZE)
+        {
+            TileIndex tile = first_tile + position * step;
+            crossable = connectivity->tile_supports_road(tile) && connectivity->tile_supports_road(tile + exit_offset);
+        }
+
+        if(crossable && run_start == -1)
+        {
+            run_start = position;
+        }
+        else if(!crossable && run_start != -1)
+        {
+            TileIndex tile = first_tile + ((run_start + position - 1) / 2) * step;
+            entrances.push_back({tile, tile + exit_offset, {}});
+            run_start = -1;
+        }
+    }
+}
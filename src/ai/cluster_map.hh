@@ -0,0 +1,95 @@
+/// \file
+#ifndef CLUSTER_MAP_HH
+#define CLUSTER_MAP_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "corridor.hh"
+#include "map_change_listener.hh"
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Abstraction layer that divides the map into square clusters for hierarchical pathfinding.
+     *
+     * Where a road can cross the edge between two clusters, an entrance is placed in the middle of each
+     * stretch of crossable edge. Each cluster stores the road distance between every pair of its own
+     * entrances, found with a search that stays inside the cluster. Clusters are built the first time they
+     * are needed, and rebuilt only after one of their tiles has changed.
+     */
+    class ClusterMap : public MapChangeListener
+    {
+    public:
+
+        static const uint32 CLUSTER_BITS = Corridor::CLUSTER_BITS;
+        static const uint32 CLUSTER_SIZE = Corridor::CLUSTER_SIZE;
+        static const uint32 CLUSTER_MASK = CLUSTER_SIZE - 1;
+
+        /**
+         * Road distance from one entrance of a cluster to another entrance of the same cluster.
+         */
+        struct Edge
+        {
+            uint32 entrance_index; ///< Index of the entrance this edge leads to.
+            int32 cost;            ///< Length of the road between the two entrances.
+        };
+
+        /**
+         * A tile on the edge of a cluster where a road can cross into the neighbouring cluster.
+         */
+        struct Entrance
+        {
+            TileIndex tile_index;      ///< The entrance tile, inside this cluster.
+            TileIndex exit_tile_index; ///< The adjacent tile inside the neighbouring cluster.
+            std::vector<Edge> edges;   ///< The other entrances of this cluster that can be reached from here.
+        };
+
+        struct Cluster
+        {
+            bool valid = false; ///< False until the cluster has been built, and again after one of its tiles changes.
+            std::vector<Entrance> entrances;
+        };
+
+        static ClusterMap* instance();
+        static void destroy();
+
+        const Cluster& cluster(const uint32 cluster_index);
+
+        void distances_in_cluster(const TileIndex source, std::vector<int32>& distances, const std::vector<Entrance>* targets = nullptr);
+
+        /// Return the position of a tile within its cluster, used to index the result of distances_in_cluster().
+        static uint32 local_index(const TileIndex tile_index)
+        {
+            return ((TileY(tile_index) & CLUSTER_MASK) << CLUSTER_BITS) | (TileX(tile_index) & CLUSTER_MASK);
+        }
+
+        void tile_changed(TileIndex tile) override;
+
+    private:
+
+        ClusterMap();
+
+        void reset_if_map_changed();
+        void invalidate_cluster(const int32 cluster_x, const int32 cluster_y);
+        void build_cluster(const uint32 cluster_index);
+        void find_entrances(const TileIndex first_tile, const int32 step, const int32 exit_offset, std::vector<Entrance>& entrances);
+
+        static ClusterMap* m_instance;
+
+        std::vector<Cluster> m_clusters;
+        uint32 m_clusters_per_row;
+        uint32 m_cluster_rows;
+        uint32 m_map_size;
+
+        // Scratch space of distances_in_cluster(), kept so that building a cluster doesn't allocate for every entrance
+        std::vector<TileIndex> m_previous_tiles;
+        std::vector<uint32> m_queue;
+        std::vector<bool> m_targets;
+    };
+}
+
+
+#endif // CLUSTER_MAP_HH
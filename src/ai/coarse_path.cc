@@ -0,0 +1,153 @@
+/// \file
+#include "coarse_path.hh"
+#include "cluster_map.hh"
+
+#include "script_map.hpp"
+
+using namespace EmpireAI;
+
+
+/// Construct a new coarse pathfinder.
+/**
+ * @param[in] start The tile at the start of the route to find.
+ * @param[in] end The tile at the end of the route to find.
+ */
+CoarsePath::CoarsePath(const TileIndex start, const TileIndex end)
+: m_start_tile_index(start), m_end_tile_index(end),
+  m_start_cluster_index(Corridor::cluster_index(start)), m_end_cluster_index(Corridor::cluster_index(end))
+{
+    ClusterMap* cluster_map = ClusterMap::instance();
+    cluster_map->distances_in_cluster(start, m_start_distances);
+    cluster_map->distances_in_cluster(end, m_end_distances);
+
+    open_node(start, INVALID_TILE, 0);
+
+    m_status = Path::IN_PROGRESS;
+}
+
+
+/// Find part of the coarse route from start to end.
+/**
+ * This function must be called repeatedly until either a route is found or it is found to be unreachable.
+ * Expanding a node can build the cluster it lies in, so keep max_node_count small.
+ * @param[in] max_node_count The maximum amount of nodes to expand before returning.
+ * @return The status of the pathfinder.
+ */
+Path::Status CoarsePath::find(const uint16 max_node_count)
+{
+    if(m_status != Path::IN_PROGRESS)
+    {
+        return m_status;
+    }
+
+    for(uint16 node_count = 0; node_count < max_node_count; node_count++)
+    {
+        if(m_open_nodes.empty())
+        {
+            m_status = Path::UNREACHABLE;
+            break;
+        }
+
+        TileIndex tile_index = std::get<2>(m_open_nodes.top());
+        m_open_nodes.pop();
+
+        Node& node = m_nodes[tile_index];
+
+        // Skip duplicates of nodes that have already been expanded
+        if(node.closed)
+        {
+            continue;
+        }
+
+        node.closed = true;
+
+        if(tile_index == m_end_tile_index)
+        {
+            build_corridor();
+            m_status = Path::FOUND;
+            break;
+        }
+
+        expand_node(tile_index, node.g);
+    }
+
+    return m_status;
+}
+
+
+/// Open every coarse node that can be reached directly from this one.
+/**
+ * @param[in] tile_index Tile of the node to expand.
+ * @param[in] g Cost of the route to this node.
+ */
+void CoarsePath::expand_node(const TileIndex tile_index, const int32 g)
+{
+    const uint32 cluster_index = Corridor::cluster_index(tile_index);
+    const ClusterMap::Cluster& cluster = ClusterMap::instance()->cluster(cluster_index);
+
+    for(const ClusterMap::Entrance& entrance : cluster.entrances)
+    {
+        // The start tile connects to the entrances of its own cluster
+        if(tile_index == m_start_tile_index)
+        {
+            int32 distance = m_start_distances[ClusterMap::local_index(entrance.tile_index)];
+
+            if(distance >= 0)
+            {
+                open_node(entrance.tile_index, tile_index, g + distance);
+            }
+        }
+
+        // An entrance connects to the other entrances of its cluster, and across the edge to the neighbouring cluster.
+        // A tile on the corner of a cluster can be an entrance on two edges.
+        if(entrance.tile_index == tile_index)
+        {
+            for(const ClusterMap::Edge& edge : entrance.edges)
+            {
+                open_node(cluster.entrances[edge.entrance_index].tile_index, tile_index, g + edge.cost);
+            }
+
+            open_node(entrance.exit_tile_index, tile_index, g + 1);
+        }
+    }
+
+    // Any node in the cluster of the end tile connects to the end tile
+    if(cluster_index == m_end_cluster_index)
+    {
+        int32 distance = m_end_distances[ClusterMap::local_index(tile_index)];
+
+        if(distance >= 0)
+        {
+            open_node(m_end_tile_index, tile_index, g + distance);
+        }
+    }
+}
+
+
+/// Open a node, unless it has already been reached at the same or a lower cost.
+void CoarsePath::open_node(const TileIndex tile_index, const TileIndex previous_tile_index, const int32 g)
+{
+    auto inserted = m_nodes.emplace(tile_index, Node());
+    Node& node = inserted.first->second;
+
+    if(!inserted.second && (node.closed || node.g <= g))
+    {
+        return;
+    }
+
+    node.g = g;
+    node.previous_tile_index = previous_tile_index;
+
+    const int32 h = ScriptMap::DistanceManhattan(tile_index, m_end_tile_index);
+    m_open_nodes.push(OpenNode(g + h, h, tile_index));
+}
+
+
+/// Add the cluster of every node on the coarse route to the corridor.
+void CoarsePath::build_corridor()
+{
+    for(TileIndex tile_index = m_end_tile_index; tile_index != INVALID_TILE; tile_index = m_nodes[tile_index].previous_tile_index)
+    {
+        m_corridor.add_cluster(Corridor::cluster_index(tile_index));
+    }
+}
@@ -0,0 +1,76 @@
+/// \file
+#ifndef COARSE_PATH_HH
+#define COARSE_PATH_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "corridor.hh"
+#include "path.hh"
+#include <queue>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Pathfinder that finds a coarse route between two tiles over the entrances of the ClusterMap.
+     *
+     * The clusters along the coarse route form a corridor that a tile-level Path can then be confined to.
+     * The cluster map only samples where roads can cross the edges of clusters, so a coarse route can be missed
+     * where a road route exists. If none is found, the caller has to fall back on a tile-level search of the whole map.
+     */
+    class CoarsePath
+    {
+    public:
+
+        CoarsePath(const TileIndex start, const TileIndex end);
+        Path::Status find(const uint16 max_node_count);
+
+        /// The clusters along the coarse route, once it has been found.
+        const Corridor& corridor() const
+        {
+            return m_corridor;
+        }
+
+    private:
+
+        /**
+         * Node of the coarse route. Coarse nodes are the start tile, the end tile and cluster entrances.
+         */
+        struct Node
+        {
+            int32 g = 0; ///< Cost of the route from the start tile to this node.
+            TileIndex previous_tile_index = INVALID_TILE; ///< The node before this one on the route.
+            bool closed = false;
+        };
+
+        /// f cost, h cost and tile of an open node. Of nodes with the same f cost, the one closer to the end goes first.
+        typedef std::tuple<int32, int32, TileIndex> OpenNode;
+
+        void expand_node(const TileIndex tile_index, const int32 g);
+        void open_node(const TileIndex tile_index, const TileIndex previous_tile_index, const int32 g);
+        void build_corridor();
+
+        Path::Status m_status;
+
+        const TileIndex m_start_tile_index;
+        const TileIndex m_end_tile_index;
+        const uint32 m_start_cluster_index;
+        const uint32 m_end_cluster_index;
+
+        std::vector<int32> m_start_distances; ///< Distances from the start tile to the tiles of its cluster.
+        std::vector<int32> m_end_distances;   ///< Distances from the end tile to the tiles of its cluster.
+
+        // The coarse graph is small, so a hash map and a queue that allows duplicates are good enough here
+        std::unordered_map<TileIndex, Node> m_nodes;
+        std::priority_queue<OpenNode, std::vector<OpenNode>, std::greater<OpenNode>> m_open_nodes;
+
+        Corridor m_corridor;
+    };
+}
+
+
+#endif // COARSE_PATH_HH
@@ -0,0 +1,143 @@
+/// \file
+#include "connectivity_cache.hh"
+#include "openttd_functions.hh"
+
+#include "map_func.h"
+
+using namespace EmpireAI;
+
+
+ConnectivityCache* ConnectivityCache::m_instance = nullptr;
+
+
+ConnectivityCache::ConnectivityCache()
+: m_next_tile(0)
+{
+}
+
+
+ConnectivityCache* ConnectivityCache::instance()
+{
+    if(m_instance == nullptr)
+    {
+        m_instance = new ConnectivityCache();
+    }
+
+    m_instance->m_entries.fit_to_map();
+    return m_instance;
+}
+
+
+/// Free the cache once no AI needs it any more. The next call to instance() starts an empty one.
+void ConnectivityCache::destroy()
+{
+    delete m_instance;
+    m_instance = nullptr;
+}
+
+
+/// Check part of the cached tiles against the map, and clear those that have changed since they were cached.
+/**
+ * Changed tiles are passed to MapChangeListener::notify_tile_changed(), so that the caches built from this one
+ * are updated as well. Tiles nothing has been cached for cost no Script API calls. Must be called on the game
+ * thread. A full pass over the map takes MapSize() / max_tile_count calls.
+ * @param[in] max_tile_count The maximum amount of tiles to check before returning.
+ */
+void ConnectivityCache::refresh(const uint32 max_tile_count)
+{
+    for(uint32 tile_count = 0; tile_count < max_tile_count; tile_count++)
+    {
+        if(m_next_tile >= MapSize())
+        {
+            m_next_tile = 0;
+        }
+
+        const TileIndex tile = m_next_tile++;
+        const Entry* entry = m_entries.find(tile);
+
+        if(entry != nullptr && entry->known != 0 && !entry_is_current(*entry, tile))
+        {
+            MapChangeListener::notify_tile_changed(tile);
+        }
+    }
+}
+
+
+/// Return true if a tile still has the slope, road and buildability it had when its entry was fetched.
+bool ConnectivityCache::entry_is_current(const Entry& entry, const TileIndex tile)
+{
+    const bool supports_road = (entry.result & SUPPORTS_ROAD_BIT) != 0;
+
+    return EmpireAI::tile_supports_road(tile) == supports_road && get_tile_slope(tile) == entry.slope &&
+        get_road_bits(tile) == entry.road_bits;
+}
+
+
+/// Fetch the results a cached lookup is missing from the game.
+/**
+ * @param[in,out] entry The cache entry of the tile.
+ * @param[in] tile The tile to be examined.
+ * @param[in] from The tile the road arrives from.
+ * @param[in] to The tile the road continues to.
+ * @param[in] bit The bit of the entry for this pair of directions.
+ */
+void ConnectivityCache::fetch(Entry& entry, const TileIndex tile, const TileIndex from, const TileIndex to, const uint16 bit)
+{
+    if((entry.known & SUPPORTS_ROAD_BIT) == 0)
+    {
+        fetch_supports_road(entry, tile);
+    }
+
+    // There is no need to ask about the directions of a tile that doesn't support roads
+    if((entry.result & SUPPORTS_ROAD_BIT) == 0 || (entry.known & bit) != 0)
+    {
+        return;
+    }
+
+    entry.known |= bit;
+
+    if(EmpireAI::can_build_road_through(tile, from, to))
+    {
+        entry.result |= bit;
+    }
+}
+
+
+/// Fetch whether a tile supports roads from the game, along with what refresh() checks to notice it has changed.
+void ConnectivityCache::fetch_supports_road(Entry& entry, const TileIndex tile)
+{
+    entry.known |= SUPPORTS_ROAD_BIT;
+    entry.slope = get_tile_slope(tile);
+    entry.road_bits = get_road_bits(tile);
+
+    if(EmpireAI::tile_supports_road(tile))
+    {
+        entry.result |= SUPPORTS_ROAD_BIT;
+    }
+}
+
+
+/// Ask the game directly about tiles that aren't next to each other, which can't be cached.
+bool ConnectivityCache::fetch_road_through(const TileIndex tile, const TileIndex from, const TileIndex to)
+{
+    return EmpireAI::can_build_road_through(tile, from, to);
+}
+
+
+/// Forget everything known about a tile.
+/**
+ * Whether a road can pass through a tile only depends on the slope and contents of that tile itself,
+ * so its neighbours stay valid.
+ */
+void ConnectivityCache::tile_changed(TileIndex tile)
+{
+    // A tile of a new, larger map may change before the cache has been used on it
+    m_entries.fit_to_map();
+
+    Entry* entry = m_entries.find(tile);
+
+    if(entry != nullptr)
+    {
+        *entry = Entry();
+    }
+}
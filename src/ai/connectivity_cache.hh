@@ -0,0 +1,151 @@
+/// \file
+#ifndef CONNECTIVITY_CACHE_HH
+#define CONNECTIVITY_CACHE_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "map_func.h"
+#include "map_change_listener.hh"
+#include "paged_tile_array.hh"
+
+
+namespace EmpireAI
+{
+    /**
+     * Memoizes the road connectivity of map tiles across searches.
+     *
+     * For each tile, the result of can_build_road_through() is stored for every pair of entry and exit
+     * directions, along with the result of tile_supports_road(). Results are fetched from the game the first
+     * time they are needed, and kept until the tile changes, so repeated searches over the same area need
+     * almost no Script API calls. The cache is shared by every Path and by the ClusterMap.
+     *
+     * Tiles the AI builds on are cleared right away through MapChangeListener. Towns, other companies and
+     * terraforming change tiles without telling the AI, so refresh() also goes over the cached tiles a slice at a
+     * time, and tells every MapChangeListener about those that no longer look the way they did when they were
+     * cached.
+     */
+    class ConnectivityCache : public MapChangeListener
+    {
+    public:
+
+        static ConnectivityCache* instance();
+        static void destroy();
+
+        void refresh(const uint32 max_tile_count);
+
+        /// Determine whether a road can be built on a tile, connecting the two tiles on either side of it.
+        /**
+         * Same as EmpireAI::can_build_road_through(), but the result is only fetched from the game once per tile
+         * and pair of directions. Cached results are read inline, since every search asks for them on each step.
+         * @param[in] tile The tile to be examined.
+         * @param[in] from The tile the road arrives from.
+         * @param[in] to The tile the road continues to.
+         * @return
+         */
+        bool can_build_road_through(const TileIndex tile, const TileIndex from, const TileIndex to)
+        {
+            const int32 from_direction = direction(tile, from);
+            const int32 to_direction = direction(tile, to);
+
+            // Only tiles next to each other can be cached
+            if(from_direction < 0 || to_direction < 0)
+            {
+                return fetch_road_through(tile, from, to);
+            }
+
+            // Turning back to the tile the road came from never leads anywhere new
+            if(from_direction == to_direction)
+            {
+                return false;
+            }
+
+            Entry& entry = m_entries[tile];
+            const uint16 bit = 1 << (from_direction * 4 + to_direction);
+
+            if((entry.known & (bit | SUPPORTS_ROAD_BIT)) != (bit | SUPPORTS_ROAD_BIT))
+            {
+                fetch(entry, tile, from, to, bit);
+            }
+
+            // No direction can be connected on a tile that doesn't support roads at all
+            return (entry.result & SUPPORTS_ROAD_BIT) != 0 && (entry.result & bit) != 0;
+        }
+
+        /// Determine whether a tile either has a road on it already, or is free to build one.
+        bool tile_supports_road(const TileIndex tile)
+        {
+            Entry& entry = m_entries[tile];
+
+            if((entry.known & SUPPORTS_ROAD_BIT) == 0)
+            {
+                fetch_supports_road(entry, tile);
+            }
+
+            return (entry.result & SUPPORTS_ROAD_BIT) != 0;
+        }
+
+        void tile_changed(TileIndex tile) override;
+
+    private:
+
+        /**
+         * Cached results for one tile, as a 4x4 bit matrix indexed by entry direction * 4 + exit direction.
+         * A road never leaves a tile the way it came in, so the first bit of the diagonal is free and
+         * holds tile_supports_road() instead.
+         */
+        struct Entry
+        {
+            uint16 known = 0;  ///< Bits of results that have been fetched.
+            uint16 result = 0; ///< The fetched results.
+            uint8 slope = 0;     ///< Slope of the tile when it was first fetched, to notice when it changes.
+            uint8 road_bits = 0; ///< Road on the tile when it was first fetched, to notice when it changes.
+        };
+
+        static const uint16 SUPPORTS_ROAD_BIT = 1;
+
+        ConnectivityCache();
+
+        void fetch(Entry& entry, const TileIndex tile, const TileIndex from, const TileIndex to, const uint16 bit);
+        void fetch_supports_road(Entry& entry, const TileIndex tile);
+        bool entry_is_current(const Entry& entry, const TileIndex tile);
+        bool fetch_road_through(const TileIndex tile, const TileIndex from, const TileIndex to);
+
+        /// Get the direction of an adjacent tile.
+        /**
+         * @return 0 to 3 for the tiles at +x, -x, +y and -y, or -1 if the tiles are not adjacent.
+         */
+        static int32 direction(const TileIndex tile, const TileIndex adjacent_tile)
+        {
+            const int32 difference = (int32)(adjacent_tile - tile);
+            const int32 row = (int32)MapSizeX();
+
+            if(difference == 1)
+            {
+                return 0;
+            }
+            if(difference == -1)
+            {
+                return 1;
+            }
+            if(difference == row)
+            {
+                return 2;
+            }
+            if(difference == -row)
+            {
+                return 3;
+            }
+
+            return -1;
+        }
+
+        static ConnectivityCache* m_instance;
+
+        PagedTileArray<Entry> m_entries;
+        TileIndex m_next_tile; ///< The tile refresh() checks next.
+    };
+}
+
+
+#endif // CONNECTIVITY_CACHE_HH
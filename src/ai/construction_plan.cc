@@ -0,0 +1,191 @@
+/// \file
+#include "construction_plan.hh"
+#include "openttd_functions.hh"
+
+#include "script_accounting.hpp"
+#include "script_error.hpp"
+#include "script_testmode.hpp"
+
+using namespace EmpireAI;
+
+
+/// Add a straight road between two tiles to the plan.
+/**
+ * @return Index of the new item.
+ */
+size_t ConstructionPlan::add_road(const TileIndex start, const TileIndex end)
+{
+    return add(ROAD, start, end);
+}
+
+
+/// Add a bus station to the plan.
+/**
+ * @param[in] tile The tile to build the station on.
+ * @param[in] front The road tile the station faces.
+ * @return Index of the new item.
+ */
+size_t ConstructionPlan::add_bus_station(const TileIndex tile, const TileIndex front)
+{
+    return add(BUS_STATION, tile, front);
+}
+
+
+/// Add a road depot to the plan.
+/**
+ * @param[in] tile The tile to build the depot on.
+ * @param[in] front The road tile the depot faces.
+ * @return Index of the new item.
+ */
+size_t ConstructionPlan::add_road_depot(const TileIndex tile, const TileIndex front)
+{
+    return add(ROAD_DEPOT, tile, front);
+}
+
+
+/// Add an item taken from another plan, keeping the result of its check.
+/**
+ * @return Index of the new item.
+ */
+size_t ConstructionPlan::add_item(const Item& item)
+{
+    m_items.push_back(item);
+    return m_items.size() - 1;
+}
+
+
+size_t ConstructionPlan::add(const ItemType type, const TileIndex tile_index, const TileIndex other_tile_index)
+{
+    Item item;
+    item.type = type;
+    item.tile_index = tile_index;
+    item.other_tile_index = other_tile_index;
+
+    return add_item(item);
+}
+
+
+/// Check every item that hasn't been checked yet, all in one test-mode scope.
+/**
+ * @return True if every item of the plan can be built.
+ */
+bool ConstructionPlan::check()
+{
+    ScriptTestMode test_mode;
+    ScriptAccounting accounting;
+
+    for(Item& item : m_items)
+    {
+        if(item.checked)
+        {
+            continue;
+        }
+
+        accounting.ResetCosts();
+
+        switch(item.type)
+        {
+            case ROAD:
+                // Parts of the route may already have a road, which is as good as building it
+                item.feasible = issue_build_road(item.tile_index, item.other_tile_index) ||
+                                ScriptError::GetLastError() == ScriptError::ERR_ALREADY_BUILT;
+                break;
+
+            case BUS_STATION:
+                item.feasible = issue_build_bus_station(item.tile_index, item.other_tile_index);
+                break;
+
+            case ROAD_DEPOT:
+                item.feasible = issue_build_road_depot(item.tile_index, item.other_tile_index);
+                break;
+        }
+
+        item.cost = accounting.GetCosts();
+        item.checked = true;
+    }
+
+    return feasible();
+}
+
+
+/// Return true if every item of the plan has been checked and can be built.
+bool ConstructionPlan::feasible() const
+{
+    for(const Item& item : m_items)
+    {
+        if(!item.checked || !item.feasible)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/// Return the cost of building every item of the plan, as found by check().
+Money ConstructionPlan::total_cost() const
+{
+    Money cost = 0;
+
+    for(const Item& item : m_items)
+    {
+        cost += item.cost;
+    }
+
+    return cost;
+}
+
+
+/// Build a single item of the plan. The item must have been checked and found feasible.
+/**
+ * @param[in] index Index of the item to build.
+ * @return True if the item was built, or is a road that was already there.
+ */
+bool ConstructionPlan::build_item(const size_t index)
+{
+    const Item& item = m_items[index];
+
+    if(!item.checked || !item.feasible)
+    {
+        return false;
+    }
+
+    switch(item.type)
+    {
+        case ROAD:
+            // check() let a road that is already there through, so it counts as built here too
+            return build_road(item.tile_index, item.other_tile_index) ||
+                   ScriptError::GetLastError() == ScriptError::ERR_ALREADY_BUILT;
+
+        case BUS_STATION:
+            return build_bus_station(item.tile_index, item.other_tile_index);
+
+        case ROAD_DEPOT:
+            return build_road_depot(item.tile_index, item.other_tile_index);
+    }
+
+    return false;
+}
+
+
+/// Build the whole plan, but only if every item of it has been checked and the company can afford it.
+/**
+ * @return True if every item was built.
+ */
+bool ConstructionPlan::build()
+{
+    if(!feasible() || total_cost() > get_bank_balance())
+    {
+        return false;
+    }
+
+    bool built = true;
+
+    for(size_t index = 0; index < m_items.size(); index++)
+    {
+        built = build_item(index) && built;
+    }
+
+    return built;
+}
@@ -0,0 +1,77 @@
+/// \file
+#ifndef CONSTRUCTION_PLAN_HH
+#define CONSTRUCTION_PLAN_HH
+
+
+#include "stdafx.h"
+#include "economy_type.h"
+#include "tile_type.h"
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * A list of construction commands that is checked as a whole before any of it is built.
+     *
+     * check() issues every command of the plan in a single test-mode scope and records, per item, whether it
+     * can be built and what it would cost. Test mode doesn't change the map, so each item is checked against
+     * the map as it is, not as the earlier items of the plan would leave it.
+     */
+    class ConstructionPlan
+    {
+    public:
+
+        enum ItemType
+        {
+            ROAD,        ///< A straight road between two tiles.
+            BUS_STATION, ///< A bus station, facing a road tile.
+            ROAD_DEPOT   ///< A road depot, facing a road tile.
+        };
+
+        /**
+         * One construction command of the plan.
+         */
+        struct Item
+        {
+            ItemType type;
+            TileIndex tile_index;       ///< Start of the road, or the tile of the station or depot.
+            TileIndex other_tile_index; ///< End of the road, or the road tile in front of the station or depot.
+            bool checked = false;       ///< True once the item has been checked in test mode.
+            bool feasible = false;      ///< True if the check found that the item can be built.
+            Money cost = 0;             ///< Cost of building the item, as found by the check.
+        };
+
+        size_t add_road(const TileIndex start, const TileIndex end);
+        size_t add_bus_station(const TileIndex tile, const TileIndex front);
+        size_t add_road_depot(const TileIndex tile, const TileIndex front);
+        size_t add_item(const Item& item);
+
+        bool check();
+
+        bool feasible() const;
+        Money total_cost() const;
+
+        bool build_item(const size_t index);
+        bool build();
+
+        const Item& item(const size_t index) const
+        {
+            return m_items[index];
+        }
+
+        size_t size() const
+        {
+            return m_items.size();
+        }
+
+    private:
+
+        size_t add(const ItemType type, const TileIndex tile_index, const TileIndex other_tile_index);
+
+        std::vector<Item> m_items;
+    };
+}
+
+
+#endif // CONSTRUCTION_PLAN_HH
@@ -0,0 +1,114 @@
+/// \file
+#ifndef CORRIDOR_HH
+#define CORRIDOR_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "map_func.h"
+#include "save_buffer.hh"
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * A set of map clusters that a search is allowed to enter.
+     *
+     * The map is divided into square clusters of CLUSTER_SIZE x CLUSTER_SIZE tiles. A corridor is usually the
+     * clusters along a coarse route, so that a tile-level search only has to explore a narrow band of the map.
+     */
+    class Corridor
+    {
+    public:
+
+        static const uint32 CLUSTER_BITS = 5;
+        static const uint32 CLUSTER_SIZE = 1 << CLUSTER_BITS;
+
+        Corridor()
+        : m_clusters_per_row(MapSizeX() >> CLUSTER_BITS), m_clusters((MapSize() >> (CLUSTER_BITS * 2)), false)
+        {}
+
+        /// Return the index of the cluster containing a tile.
+        static uint32 cluster_index(const TileIndex tile_index)
+        {
+            return (TileY(tile_index) >> CLUSTER_BITS) * (MapSizeX() >> CLUSTER_BITS) + (TileX(tile_index) >> CLUSTER_BITS);
+        }
+
+        /// Return the northern corner tile of a cluster.
+        static TileIndex cluster_origin(const uint32 cluster_index)
+        {
+            const uint32 clusters_per_row = MapSizeX() >> CLUSTER_BITS;
+            return TileXY((cluster_index % clusters_per_row) << CLUSTER_BITS, (cluster_index / clusters_per_row) << CLUSTER_BITS);
+        }
+
+        void add_cluster(const uint32 cluster_index)
+        {
+            m_clusters[cluster_index] = true;
+        }
+
+        /// Return the number of clusters on the map, whether they are part of the corridor or not.
+        uint32 cluster_count() const
+        {
+            return m_clusters.size();
+        }
+
+        /// Return true if the cluster is part of the corridor.
+        bool contains_cluster(const uint32 cluster_index) const
+        {
+            return m_clusters[cluster_index];
+        }
+
+        /// Write the clusters of the corridor, one bit each.
+        void save(SaveWriter& writer) const
+        {
+            writer.write_uint32(cluster_count());
+
+            for(uint32 first = 0; first < cluster_count(); first += 8)
+            {
+                uint8 bits = 0;
+
+                for(uint32 bit = 0; bit < 8 && first + bit < cluster_count(); bit++)
+                {
+                    bits |= (uint8)(m_clusters[first + bit] << bit);
+                }
+
+                writer.write_uint8(bits);
+            }
+        }
+
+        /// Add the clusters written by save(). The corridor must have been saved on a map of the same size.
+        void load(SaveReader& reader)
+        {
+            if(reader.read_uint32() != cluster_count())
+            {
+                reader.fail();
+                return;
+            }
+
+            for(uint32 first = 0; first < cluster_count(); first += 8)
+            {
+                const uint8 bits = reader.read_uint8();
+
+                for(uint32 bit = 0; bit < 8 && first + bit < cluster_count(); bit++)
+                {
+                    m_clusters[first + bit] = m_clusters[first + bit] || (bits >> bit & 1) != 0;
+                }
+            }
+        }
+
+        /// Return true if the tile lies in one of the clusters of the corridor.
+        bool contains(const TileIndex tile_index) const
+        {
+            return m_clusters[(TileY(tile_index) >> CLUSTER_BITS) * m_clusters_per_row + (TileX(tile_index) >> CLUSTER_BITS)];
+        }
+
+    private:
+
+        uint32 m_clusters_per_row;
+        std::vector<bool> m_clusters;
+    };
+}
+
+
+#endif // CORRIDOR_HH
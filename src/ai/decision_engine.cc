@@ -1,255 +1,697 @@
 /// \file
 
 #include "decision_engine.hh"
+#include "landmark_map.hh"
+#include "logger.hh"
 #include "openttd_functions.hh"
 #include "road_station_builder.hh"
 
-#include <iostream>
+#include <chrono>
+#include <cstdlib>
 #include <vector>
 
 #include "stdafx.h"
+#include "date_func.h"
 #include "town.h"
 #include "script_map.hpp"
 
 using namespace EmpireAI;
 
 
-DecisionEngine::DecisionEngine()
+Route::Route()
 {
-    m_state = Init::instance();
+    stage = INIT;
+    waiting = false;
+    town_1 = INVALID_TOWN;
+    town_2 = INVALID_TOWN;
+    location_1 = INVALID_TILE;
+    location_2 = INVALID_TILE;
+    source = INVALID_TILE;
+    destination = INVALID_TILE;
+    plan_checked = false;
 }
 
 
-void DecisionEngine::change_state(DecisionEngineState* state)
+/// Discard the searches and builders of the previous route. The task is kept.
+void Route::clear()
 {
-    m_state = state;
+    // The road builder refers to the path, so it goes first
+    road_builder.reset();
+    async_path.reset();
+    coarse_path.reset();
+    path.reset();
+
+    seed_routes.clear();
+    plan_checked = false;
 }
 
 
-void DecisionEngine::update()
+const char* Route::stage_name() const
 {
-    m_state->update(this);
+    static const char* const names[STAGE_COUNT] = {"Init", "NewCargoRoute", "FindPath", "BuildRoad", "BuildStations"};
+    return names[stage];
 }
 
 
-void DecisionEngineState::update(DecisionEngine* decision_engine)
+DecisionEngine::DecisionEngine()
+: m_map_caches(SharedMapCaches::acquire()), m_next_route(0), m_company_set_up(false)
 {
+    // Metrics are always recorded, but only written to files if asked for
+    const char* metrics_file_prefix = std::getenv("EMPIRE_AI_METRICS");
 
+    if(metrics_file_prefix != nullptr)
+    {
+        m_metrics.dump_every(METRICS_DUMP_TICKS, metrics_file_prefix);
+    }
+
+    for(Route& route : m_routes)
+    {
+        start_task(route);
+    }
 }
 
 
-void DecisionEngineState::change_state(DecisionEngine* decision_engine, DecisionEngineState* state)
+/// Let the routes do as much work as fits in the time budget of this tick.
+/**
+ * Each resume of a route's task does one small step of work on it, up to its next next_step() or next_tick().
+ * The routes take turns, one step each, so that every route makes progress whatever stage it is in. Steps are
+ * repeated until the budget is used up or every route has to wait for the next tick. The next tick carries on
+ * with the route after the last one that had a turn. The time of each step is recorded against the stage the
+ * route was in when it started.
+ */
+void DecisionEngine::update()
 {
-    decision_engine->change_state(state);
-}
+    typedef std::chrono::steady_clock Clock;
 
+    Metrics::Scope metrics_scope(&m_metrics);
 
-Init* Init::m_instance = nullptr;
+    m_tick_budget.start_tick();
 
+    // Only the first AI to run in a tick does this, for every AI
+    m_map_caches->refresh(_tick_counter);
 
-DecisionEngineState* Init::instance()
-{
-    if(m_instance == nullptr)
+    m_town_index.refresh_if_needed();
+    m_path_cache.reset_if_map_changed();
+
+    for(Route& route : m_routes)
     {
-        m_instance = new Init();
+        route.waiting = false;
     }
 
-    return m_instance;
-}
+    uint32 waiting_count = 0;
 
+    do
+    {
+        Route& route = m_routes[m_next_route];
+        m_next_route = (m_next_route + 1) % PIPELINE_DEPTH;
 
-void Init::update(DecisionEngine* decision_engine)
-{
-    std::cout << "\nInit" << std::flush;
+        if(route.waiting)
+        {
+            continue;
+        }
+
+        const char* stage_name = route.stage_name();
+        const Clock::time_point step_start = Clock::now();
 
-    // For testing, get some free money
-    get_money(100000000);
+        route.resume_point.resume();
 
-    // Set company name
-    rename_company("Empire Transport");
+        const int64 step_us = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - step_start).count();
+        m_metrics.state_timer(stage_name).record(step_us);
 
-    std::cout << "\nChoosing cargo route" << std::flush;
+        if(route.waiting)
+        {
+            waiting_count++;
+        }
+    }
+    while(waiting_count < PIPELINE_DEPTH && !m_tick_budget.exhausted());
 
-    NewCargoRoute* new_cargo_route = static_cast<NewCargoRoute*>(NewCargoRoute::instance());
-    change_state(decision_engine, new_cargo_route);
+    Metrics::record(Metrics::TICK_US, m_tick_budget.elapsed_us());
+    m_metrics.tick();
 }
 
 
-NewCargoRoute* NewCargoRoute::m_instance = nullptr;
+/// Start a new task for a route, which begins at the stage the route is in once the route next has a turn.
+void DecisionEngine::start_task(Route& route)
+{
+    route.task = run_route(route);
+    route.resume_point = route.task.handle();
+    route.waiting = false;
+}
 
 
-DecisionEngineState* NewCargoRoute::instance()
+/// Work through the stages of one route after another, for as long as the AI runs.
+/**
+ * Each stage moves the route on to the stage that comes next, which for the last stage, or a route that has
+ * failed, is INIT again. A route loaded from a savegame starts at the stage it was saved in.
+ * @param[in] route The route to work on.
+ */
+Task<> DecisionEngine::run_route(Route& route)
 {
-    if(m_instance == nullptr)
+    while(true)
     {
-        m_instance = new NewCargoRoute();
-    }
+        switch(route.stage)
+        {
+            case Route::INIT:
+                init(route);
+                break;
 
-    return m_instance;
+            case Route::NEW_CARGO_ROUTE:
+                co_await new_cargo_route(route);
+                break;
+
+            case Route::FIND_PATH:
+                co_await find_path(route);
+                break;
+
+            case Route::BUILD_ROAD:
+                co_await build_road(route);
+                break;
+
+            case Route::BUILD_STATIONS:
+                build_stations(route);
+                break;
+
+            case Route::STAGE_COUNT:
+                route.stage = Route::INIT;
+                break;
+        }
+
+        co_await next_step(route);
+    }
 }
 
 
-void NewCargoRoute::update(DecisionEngine* decision_engine)
+void DecisionEngine::init(Route& route)
 {
-    // Choose two random towns and create a new Path object between them
-    Town* town1 = Town::GetRandom();
-    Town* town2 = Town::GetRandom();
+    Logger::info("Init");
 
-    // If the second town is the same as the first, choose a different second town
-    while(town2 == town1)
+    // The route worked on before has been finished or has failed, and isn't tried again until the index is refreshed
+    if(route.town_1 != INVALID_TOWN)
     {
-        town2 = Town::GetRandom();
+        m_town_index.set_tried(route.town_1, route.town_2);
+        release_towns(route);
     }
 
-    print_town_name(town1);
-    print_town_name(town2);
+    // Only once, not each time a route starts over or a saved game is loaded
+    if(!m_company_set_up)
+    {
+        // For testing, get some free money
+        get_money(100000000);
 
-    TileIndex town1_location = town1->xy;
-    TileIndex town2_location = town2->xy;
+        // Set company name
+        rename_company("Empire Transport");
 
-    std::cout << "\nFinding path" << std::flush;
+        m_company_set_up = true;
+    }
 
-    // Pass the source and destination into BuildStations, to be used once a path is found
-    BuildStations* build_stations = static_cast<BuildStations*>(BuildStations::instance());
-    build_stations->set_locations(town1_location, town2_location);
+    Logger::info("Choosing cargo route");
 
-    FindPath* find_path = static_cast<FindPath*>(FindPath::instance());
-    find_path->set_source_and_destination(town1_location, town2_location);
-    change_state(decision_engine, find_path);
+    route.stage = Route::NEW_CARGO_ROUTE;
 }
 
 
-FindPath* FindPath::m_instance = nullptr;
+Task<> DecisionEngine::new_cargo_route(Route& route)
+{
+    // Choose the best pair of towns that hasn't been tried yet and create a new Path object between them
+    TownID town1_id;
+    TownID town2_id;
+
+    // Try again once the index has been refreshed
+    while(!m_town_index.choose_route(town1_id, town2_id))
+    {
+        co_await next_tick(route);
+    }
+
+    // No two routes work on the same towns
+    m_town_index.start_route(town1_id, town2_id);
 
+    Town* town1 = Town::Get(town1_id);
+    Town* town2 = Town::Get(town2_id);
 
-FindPath::FindPath()
-{
-    m_path = nullptr;
+    print_town_name(town1);
+    print_town_name(town2);
+
+    Logger::info("Finding path");
+
+    // Keep the towns with the route, to be used by BuildStations once a path is found
+    route.clear();
+    route.town_1 = town1_id;
+    route.town_2 = town2_id;
+    route.location_1 = town1->xy;
+    route.location_2 = town2->xy;
+
+    set_source_and_destination(route, route.location_1, route.location_2);
+    route.stage = Route::FIND_PATH;
 }
 
 
-DecisionEngineState* FindPath::instance()
+/// Let other routes pick the towns of a route again, and forget them.
+void DecisionEngine::release_towns(Route& route)
 {
-    if(m_instance == nullptr)
+    if(route.town_1 != INVALID_TOWN)
     {
-        m_instance = new FindPath();
+        m_town_index.end_route(route.town_1, route.town_2);
     }
 
-    return m_instance;
+    route.town_1 = INVALID_TOWN;
+    route.town_2 = INVALID_TOWN;
 }
 
 
-void FindPath::set_source_and_destination(TileIndex source, TileIndex destination)
+void DecisionEngine::set_source_and_destination(Route& route, TileIndex source, TileIndex destination)
 {
-    if(m_path != nullptr)
+    route.path.reset();
+    route.coarse_path.reset();
+    route.async_path.reset();
+
+    route.source = source;
+    route.destination = destination;
+
+    std::vector<TileIndex> cached_route;
+
+    // A route between the same towns may have been found before
+    if(m_path_cache.find_route(source, destination, cached_route))
+    {
+        route.path.reset(new Path(source, destination));
+        route.path->set_route(cached_route);
+        return;
+    }
+
+    // A road doesn't have a direction, so search from whichever end already has cached routes
+    m_path_cache.routes_from(source, route.seed_routes);
+
+    if(route.seed_routes.empty())
     {
-        delete m_path;
+        m_path_cache.routes_from(destination, route.seed_routes);
+
+        if(!route.seed_routes.empty())
+        {
+            std::swap(route.source, route.destination);
+        }
     }
 
-    m_path = new Path(source, destination);
+    // Find a coarse route over the cluster map first, then search for the road along it
+    route.coarse_path.reset(new CoarsePath(route.source, route.destination));
 }
 
 
-void FindPath::update(DecisionEngine* decision_engine)
+/// Search for the path of a route, a few nodes per step.
+/**
+ * The search goes over the cluster map first, then along the corridor it found on a worker thread, and finally
+ * over the whole live map if either fails. A route loaded from a savegame carries on with whichever search it had.
+ * @param[in] route The route to search for.
+ */
+Task<> DecisionEngine::find_path(Route& route)
 {
-    Path::Status find_status = m_path->find(100);
+    if(route.coarse_path != nullptr)
+    {
+        Path::Status coarse_status = route.coarse_path->find(COARSE_NODES_PER_STEP);
+
+        while(coarse_status == Path::IN_PROGRESS)
+        {
+            co_await next_step(route);
+            coarse_status = route.coarse_path->find(COARSE_NODES_PER_STEP);
+        }
+
+        if(coarse_status == Path::FOUND)
+        {
+            // The search may also follow the cached routes it starts from
+            Corridor corridor = route.coarse_path->corridor();
+
+            for(const std::vector<TileIndex>& seed_route : route.seed_routes)
+            {
+                for(const TileIndex tile_index : seed_route)
+                {
+                    corridor.add_cluster(Corridor::cluster_index(tile_index));
+                }
+            }
+
+            route.async_path.reset(new AsyncPath(route.source, route.destination, corridor));
+
+            for(const std::vector<TileIndex>& seed_route : route.seed_routes)
+            {
+                route.async_path->seed_route(seed_route);
+            }
+        }
+        else
+        {
+            // The entrances of the cluster map are only samples of each cluster edge, so it can miss a way through
+            Logger::info("No coarse route found, searching the whole map");
+        }
+
+        route.coarse_path.reset();
+
+        co_await next_step(route);
+    }
+
+    if(route.async_path != nullptr)
+    {
+        Path::Status async_status = route.async_path->find();
+
+        // Once the snapshot is taken, there is nothing to do but wait for the worker
+        while(async_status == Path::IN_PROGRESS)
+        {
+            co_await (route.async_path->searching() ? next_tick(route) : next_step(route));
+            async_status = route.async_path->find();
+        }
+
+        if(async_status == Path::FOUND)
+        {
+            route.path.reset(route.async_path->release_path());
+        }
+
+        route.async_path.reset();
+    }
+
+    if(route.path == nullptr)
+    {
+        // The corridor is only an estimate, and the map may have changed during the search,
+        // so search the whole live map before giving up. Any reasonably short road will do.
+        route.path.reset(new Path(route.source, route.destination, Path::ANYTIME));
+        route.path->set_landmarks(LandmarkMap::instance()->tables());
+
+        for(const std::vector<TileIndex>& seed_route : route.seed_routes)
+        {
+            route.path->seed_route(seed_route);
+        }
+    }
+
+    Path::Status find_status = route.path->find(NODES_PER_STEP);
+
+    while(true)
+    {
+        // Stop improving the path once it is close enough to the shortest
+        if(find_status == Path::IN_PROGRESS && route.path->has_route() &&
+            route.path->suboptimality_bound() <= 1.0 + ACCEPTED_DETOUR_PERCENT / 100.0)
+        {
+            route.path->accept_route();
+            find_status = Path::FOUND;
+        }
+
+        if(find_status != Path::IN_PROGRESS)
+        {
+            break;
+        }
+
+        co_await next_step(route);
+        find_status = route.path->find(NODES_PER_STEP);
+    }
+
     if(find_status == Path::FOUND)
     {
-        std::cout << "\nPath found, building road" << std::flush;
+        Logger::info("Path found, building road");
 
-        BuildRoad* build_road = static_cast<BuildRoad*>(BuildRoad::instance());
-        build_road->set_path(m_path);
-        change_state(decision_engine, build_road);
+        m_path_cache.insert(*route.path);
+
+        // Prepare to build a road along the path that has been found
+        route.road_builder.reset(new RoadBuilder(*route.path));
+        route.plan_checked = false;
+        route.stage = Route::BUILD_ROAD;
     }
     if(find_status == Path::UNREACHABLE)
     {
-        std::cout << "\nDestination unreachable" << std::flush;
-        change_state(decision_engine, Init::instance());
+        Logger::warning("Destination unreachable");
+        route.stage = Route::INIT;
     }
 }
 
 
-BuildRoad* BuildRoad::m_instance = nullptr;
+/// Build the road along the path of a route, one straight run per step.
+Task<> DecisionEngine::build_road(Route& route)
+{
+    // Only build roads that have been checked as a whole
+    if(!route.plan_checked)
+    {
+        route.plan_checked = true;
 
+        if(!route.road_builder->check_plan())
+        {
+            Logger::warning("Road can't be built");
+            route.stage = Route::INIT;
+            co_return;
+        }
 
-BuildRoad::BuildRoad()
-{
-    m_road_builder = nullptr;
-    m_path = nullptr;
+        co_await next_step(route);
+    }
+
+    RoadBuilder::Status status = route.road_builder->build_road_segment();
+
+    while(status == RoadBuilder::IN_PROGRESS)
+    {
+        co_await next_step(route);
+        status = route.road_builder->build_road_segment();
+    }
+
+    if(status == RoadBuilder::BUILT)
+    {
+        Logger::info("Road construction complete, building stations");
+        route.stage = Route::BUILD_STATIONS;
+    }
+    else
+    {
+        Logger::warning("Road was built over and couldn't be repaired");
+        route.stage = Route::INIT;
+    }
 }
 
 
-DecisionEngineState* BuildRoad::instance()
+void DecisionEngine::build_stations(Route& route)
 {
-    if(m_instance == nullptr)
+    RoadStationBuilder road_station_builder(*route.path);
+
+    if(road_station_builder.build_bus_stations())
     {
-        m_instance = new BuildRoad();
+        m_town_index.set_connected(route.town_1);
+        m_town_index.set_connected(route.town_2);
     }
 
-    return m_instance;
+    route.clear();
+    route.stage = Route::INIT;
 }
 
 
-void BuildRoad::set_path(Path* path)
+/// Write the routes in progress into a savegame, so that loading it carries on with them where they stopped.
+void DecisionEngine::save(SaveWriter& writer)
 {
-    if(m_road_builder != nullptr)
+    writer.write_uint8(SAVE_VERSION);
+    writer.write_uint8(m_company_set_up);
+    writer.write_uint32(m_next_route);
+
+    for(Route& route : m_routes)
     {
-        delete m_road_builder;
+        save_route(writer, route);
     }
-
-    m_road_builder = new RoadBuilder(*path);
-    m_path = path;
 }
 
 
-void BuildRoad::update(DecisionEngine* decision_engine)
+/// Carry on with the routes written by save().
+/**
+ * If the data is invalid, every route starts over at its first stage, as it would without a savegame. Whether the company has
+ * been set up is kept even then, so that it isn't given its starting money twice.
+ * @param[in] reader The reader to read the routes from.
+ * @return True if every route was loaded.
+ */
+bool DecisionEngine::load(SaveReader& reader)
 {
-    for(uint8_t count = 0; count < 2; count++)
+    if(reader.read_uint8() != SAVE_VERSION)
     {
-        if(m_road_builder->build_road_segment())
-        {
-            std::cout << "\nRoad construction complete, building stations" << std::flush;
+        return false;
+    }
 
-            BuildStations* build_stations = static_cast<BuildStations*>(BuildStations::instance());
-            build_stations->set_path(m_path);
-            change_state(decision_engine, build_stations);
-            break;
-        }
+    // The loaded routes replace whatever the routes were working on
+    for(Route& route : m_routes)
+    {
+        release_towns(route);
     }
-}
 
+    m_company_set_up = reader.read_uint8() != 0;
+    m_next_route = reader.read_uint32() % PIPELINE_DEPTH;
 
-BuildStations* BuildStations::m_instance = nullptr;
+    bool loaded = true;
 
+    for(Route& route : m_routes)
+    {
+        loaded = loaded && load_route(reader, route);
+    }
 
-DecisionEngineState* BuildStations::instance()
-{
-    if(m_instance == nullptr)
+    if(loaded)
+    {
+        return true;
+    }
+
+    for(Route& route : m_routes)
     {
-        m_instance = new BuildStations();
+        route.task = Task<>();
+        route.clear();
+        release_towns(route);
+        route.stage = Route::INIT;
+        start_task(route);
     }
 
-    return m_instance;
+    return false;
 }
 
 
-void BuildStations::set_path(Path* path)
+/// Write a route, with the search or the road builder of the stage it is in.
+/**
+ * Every search is written node by node, so that it carries on where it stopped once loaded. A search on a worker
+ * thread is stopped between two steps while it is written.
+ * @param[out] writer The writer to append the route to.
+ * @param[in] route The route to save.
+ */
+void DecisionEngine::save_route(SaveWriter& writer, Route& route)
 {
-	m_path = path;
-}
+    writer.write_uint8(route.stage);
+
+    // The first stages start each route from scratch
+    if(route.stage == Route::INIT || route.stage == Route::NEW_CARGO_ROUTE)
+    {
+        return;
+    }
 
+    writer.write_uint16(route.town_1);
+    writer.write_uint16(route.town_2);
+    writer.write_uint32(route.location_1);
+    writer.write_uint32(route.location_2);
+    writer.write_uint32(route.source);
+    writer.write_uint32(route.destination);
 
-void BuildStations::update(DecisionEngine* decision_engine)
-{
-    RoadStationBuilder road_station_builder(*m_path);
-    road_station_builder.build_bus_stations();
+    writer.write_uint32((uint32)route.seed_routes.size());
 
-    change_state(decision_engine, Init::instance());
+    for(const std::vector<TileIndex>& seed_route : route.seed_routes)
+    {
+        writer.write_tiles(seed_route);
+    }
+
+    uint8 saved_parts = 0;
+    saved_parts |= route.coarse_path != nullptr ? SAVED_COARSE_PATH : 0;
+    saved_parts |= route.async_path != nullptr ? SAVED_ASYNC_PATH : 0;
+    saved_parts |= route.path != nullptr ? SAVED_PATH : 0;
+    saved_parts |= route.road_builder != nullptr ? SAVED_ROAD_BUILDER : 0;
+    writer.write_uint8(saved_parts);
+
+    if(route.async_path != nullptr)
+    {
+        route.async_path->save(writer);
+    }
+
+    if(route.path != nullptr)
+    {
+        route.path->save(writer);
+    }
+
+    if(route.road_builder != nullptr)
+    {
+        route.road_builder->save(writer);
+        writer.write_uint8(route.plan_checked);
+    }
 }
 
 
-void BuildStations::set_locations(TileIndex location_1, TileIndex location_2)
+/// Read a route written by save_route(), and start a task that carries on at the stage it was saved in.
+/**
+ * @param[in] reader The reader to read the route from.
+ * @param[out] route The route to load into.
+ * @return True if the route was valid.
+ */
+bool DecisionEngine::load_route(SaveReader& reader, Route& route)
 {
-	m_location_1 = location_1;
-	m_location_2 = location_2;
+    // The task may be using the data of the route, so it goes first
+    route.task = Task<>();
+    route.clear();
+
+    const uint8 stage = reader.read_uint8();
+
+    if(stage >= Route::STAGE_COUNT || reader.failed())
+    {
+        return false;
+    }
+
+    route.stage = (Route::Stage)stage;
+
+    if(route.stage == Route::INIT || route.stage == Route::NEW_CARGO_ROUTE)
+    {
+        start_task(route);
+        return true;
+    }
+
+    route.town_1 = reader.read_uint16();
+    route.town_2 = reader.read_uint16();
+    route.location_1 = reader.read_tile();
+    route.location_2 = reader.read_tile();
+    route.source = reader.read_tile();
+    route.destination = reader.read_tile();
+
+    const uint32 seed_route_count = reader.read_uint32();
+
+    for(uint32 index = 0; index < seed_route_count && !reader.failed(); index++)
+    {
+        route.seed_routes.emplace_back();
+        reader.read_tiles(route.seed_routes.back());
+    }
+
+    if(reader.failed() || !Town::IsValidID(route.town_1) || !Town::IsValidID(route.town_2))
+    {
+        return false;
+    }
+
+    const uint8 saved_parts = reader.read_uint8();
+
+    if((saved_parts & SAVED_COARSE_PATH) != 0)
+    {
+        route.coarse_path.reset(new CoarsePath(route.source, route.destination));
+    }
+
+    if((saved_parts & SAVED_ASYNC_PATH) != 0)
+    {
+        route.async_path.reset(AsyncPath::load(reader));
+
+        if(route.async_path == nullptr)
+        {
+            return false;
+        }
+    }
+
+    if((saved_parts & SAVED_PATH) != 0)
+    {
+        route.path.reset(Path::load(reader, LandmarkMap::instance()->tables()));
+
+        if(route.path == nullptr)
+        {
+            return false;
+        }
+    }
+
+    if((saved_parts & SAVED_ROAD_BUILDER) != 0)
+    {
+        if(route.path == nullptr)
+        {
+            return false;
+        }
+
+        route.road_builder.reset(new RoadBuilder(*route.path));
+
+        if(!route.road_builder->load(reader))
+        {
+            return false;
+        }
+
+        route.plan_checked = reader.read_uint8() != 0;
+    }
+
+    // Every stage from here on needs a search or a path to work on, and BUILD_ROAD its road builder
+    const bool searching = route.coarse_path != nullptr || route.async_path != nullptr || route.path != nullptr;
+
+    if(reader.failed() || !searching ||
+        (route.stage == Route::BUILD_ROAD && route.road_builder == nullptr) ||
+        (route.stage == Route::BUILD_STATIONS && route.path == nullptr))
+    {
+        return false;
+    }
+
+    // No other route may pick the same towns
+    m_town_index.start_route(route.town_1, route.town_2);
+
+    start_task(route);
+    return true;
 }
@@ -3,141 +3,201 @@
 #ifndef DECISION_ENGINE_HH
 #define DECISION_ENGINE_HH
 
+#include "async_path.hh"
+#include "coarse_path.hh"
+#include "metrics.hh"
 #include "path.hh"
+#include "path_cache.hh"
 #include "road_builder.hh"
+#include "save_buffer.hh"
+#include "shared_map_caches.hh"
+#include "task.hh"
+#include "tick_budget.hh"
+#include "town_index.hh"
 
-namespace EmpireAI
-{
-
-    class DecisionEngineState;
-
-    class DecisionEngine
-    {
-    public:
-
-        DecisionEngine();
-        void update();
-
-    private:
-
-        friend class DecisionEngineState;
-        void change_state(DecisionEngineState* state);
-
-        DecisionEngineState* m_state;
-    };
-
+#include "town_type.h"
 
-    class DecisionEngineState
-    {
-    public:
-
-        virtual ~DecisionEngineState(){}
-
-        virtual void update(DecisionEngine* decision_engine);
-
-    protected:
-
-        void change_state(DecisionEngine* decision_engine, DecisionEngineState* state);
-    };
-
-
-    class Init : public DecisionEngineState
-    {
-    public:
-
-        static DecisionEngineState* instance();
-        void update(DecisionEngine* decision_engine);
-
-    protected:
-
-        Init(){}
-
-    private:
-
-        static Init* m_instance;
-    };
+#include <array>
+#include <coroutine>
+#include <memory>
+#include <vector>
 
+namespace EmpireAI
+{
 
-    class NewCargoRoute : public DecisionEngineState
+    /**
+     * One route in progress, with the task that works on it and everything the task needs.
+     *
+     * The data of the route is kept here rather than in the task, so that it can be saved, and a loaded route can
+     * be picked up by a new task at the stage it was saved in.
+     */
+    struct Route
     {
-    public:
-
-        static DecisionEngineState* instance();
-        void update(DecisionEngine* decision_engine);
-
-    protected:
-
-        NewCargoRoute(){}
-
-    private:
-
-        static NewCargoRoute* m_instance;
-    };
+        /// What is being done for the route. Saved as a number, so new stages go at the end.
+        enum Stage : uint8
+        {
+            INIT,
+            NEW_CARGO_ROUTE,
+            FIND_PATH,
+            BUILD_ROAD,
+            BUILD_STATIONS,
+            STAGE_COUNT
+        };
 
+        Route();
 
-    class FindPath : public DecisionEngineState
-    {
-    public:
+        void clear();
 
-        static DecisionEngineState* instance();
-        void update(DecisionEngine* decision_engine);
+        /// Name of the stage in the metrics.
+        const char* stage_name() const;
 
-        void set_source_and_destination(TileIndex source, TileIndex destination);
+        Stage stage;
+        bool waiting; ///< True once the task has nothing more to do for this route this tick.
 
-    protected:
+        TownID town_1;
+        TownID town_2;
+        TileIndex location_1;
+        TileIndex location_2;
 
-        FindPath();
+        TileIndex source;      ///< Tile the search starts from. One of the two locations.
+        TileIndex destination; ///< Tile the search ends at. The other location.
+        std::vector<std::vector<TileIndex>> seed_routes; ///< Cached routes from the source tile to start the search from.
 
-    private:
+        std::unique_ptr<CoarsePath> coarse_path;
+        std::unique_ptr<AsyncPath> async_path;
+        std::unique_ptr<Path> path;
 
-        static FindPath* m_instance;
+        std::unique_ptr<RoadBuilder> road_builder;
+        bool plan_checked;
 
-        Path* m_path;
+        std::coroutine_handle<> resume_point; ///< Where the task carries on the next time the route has a turn.
+        Task<> task; ///< Declared last, so that it is destroyed before the data it works on.
     };
 
 
-    class BuildRoad : public DecisionEngineState
-    {
-    public:
-
-        static DecisionEngineState* instance();
-        void update(DecisionEngine* decision_engine);
-
-        void set_path(Path* path);
-
-    protected:
-
-        BuildRoad();
-
-    private:
-
-        static BuildRoad* m_instance;
-
-        RoadBuilder* m_road_builder;
-        Path* m_path;
-    };
-
-
-    class BuildStations : public DecisionEngineState
+    /**
+     * Works on several routes at once, each in its own task, so that one route can be searched for while
+     * another is being built. All routes share the time budget of a tick.
+     *
+     * Each task is a coroutine that goes through the stages of a route from start to finish, and then starts the
+     * next route. After each small step of work it awaits next_step(), which hands the turn to the next route, or
+     * next_tick() if it can't get any further until the game has moved on. update() resumes the tasks in turn
+     * until the budget of the tick is used up. Everything the tasks work on belongs to this DecisionEngine, apart
+     * from the SharedMapCaches, so any number of AIs can run side by side.
+     */
+    class DecisionEngine
     {
     public:
 
-        static DecisionEngineState* instance();
-        void update(DecisionEngine* decision_engine);
+        DecisionEngine();
+        DecisionEngine(const DecisionEngine&) = delete;
+        DecisionEngine& operator=(const DecisionEngine&) = delete;
 
-        void set_locations(TileIndex location_1, TileIndex location_2);
-        void set_path(Path* path);
+        void update();
 
-    protected:
+        void save(SaveWriter& writer);
+        bool load(SaveReader& reader);
 
-        BuildStations(){}
+        /// The metrics of this AI, which can be written out at any time.
+        const Metrics& metrics() const
+        {
+            return m_metrics;
+        }
 
     private:
 
-        static BuildStations* m_instance;
-        TileIndex m_location_1;
-        TileIndex m_location_2;
-        Path* m_path;
+        /**
+         * Awaited by the task of a route to give the turn to the next route.
+         *
+         * The task carries on where it left off the next time its route has a turn, which is later in the same
+         * tick unless the budget of the tick has been used up, or in the next tick if it waits for it.
+         */
+        class Yield
+        {
+        public:
+
+            Yield(Route& route, const bool wait_until_next_tick)
+            : m_route(route), m_wait_until_next_tick(wait_until_next_tick)
+            {}
+
+            bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            void await_suspend(std::coroutine_handle<> handle) noexcept
+            {
+                m_route.resume_point = handle;
+                m_route.waiting = m_wait_until_next_tick;
+            }
+
+            void await_resume() const noexcept {}
+
+        private:
+
+            Route& m_route;
+            bool m_wait_until_next_tick;
+        };
+
+        /// Give the turn to the next route after a small step of work.
+        static Yield next_step(Route& route)
+        {
+            return Yield(route, false);
+        }
+
+        /// Stop working on a route until the next tick, when it can't make progress until the game has moved on.
+        static Yield next_tick(Route& route)
+        {
+            return Yield(route, true);
+        }
+
+        void start_task(Route& route);
+        Task<> run_route(Route& route);
+
+        void init(Route& route);
+        Task<> new_cargo_route(Route& route);
+        void release_towns(Route& route);
+        void set_source_and_destination(Route& route, TileIndex source, TileIndex destination);
+        Task<> find_path(Route& route);
+        Task<> build_road(Route& route);
+        void build_stations(Route& route);
+
+        void save_route(SaveWriter& writer, Route& route);
+        bool load_route(SaveReader& reader, Route& route);
+
+        /// Routes in progress at the same time
+        static const uint32 PIPELINE_DEPTH = 3;
+
+        /// Ticks between dumps of the metrics, if they are dumped to files. About once a game month.
+        static const uint32 METRICS_DUMP_TICKS = 2220;
+
+        /// Work done per step of a search, kept small so that the DecisionEngine can stop close to its time budget
+        static const uint16 COARSE_NODES_PER_STEP = 4;
+        static const uint16 NODES_PER_STEP = 50;
+
+        /// A path found by the whole-map search is taken once it is at most this many percent longer than the shortest
+        static const uint32 ACCEPTED_DETOUR_PERCENT = 20;
+
+        /// Version of the data written by save(). Data of any other version is discarded on loading.
+        static const uint8 SAVE_VERSION = 2;
+
+        /// What a saved route has, besides the stage it is in
+        static const uint8 SAVED_COARSE_PATH = 0x01;
+        static const uint8 SAVED_ASYNC_PATH = 0x02;
+        static const uint8 SAVED_PATH = 0x04;
+        static const uint8 SAVED_ROAD_BUILDER = 0x08;
+
+        std::shared_ptr<SharedMapCaches> m_map_caches; ///< Declared first, so that the routes release the caches first.
+        Metrics m_metrics; ///< Declared before the routes, so that their searches on worker threads stop recording first.
+
+        TownIndex m_town_index; ///< The towns this AI has connected or is trying to.
+        PathCache m_path_cache; ///< The routes this AI has found.
+
+        std::array<Route, PIPELINE_DEPTH> m_routes;
+        uint32 m_next_route; ///< The route that gets the next turn.
+        bool m_company_set_up; ///< True once the company has been given its name and starting money.
+
+        TickBudget m_tick_budget; ///< Time the routes may share in each tick.
     };
 }
 
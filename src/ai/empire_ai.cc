@@ -1,12 +1,40 @@
 #include "empire_ai.hh"
+#include "decision_engine.hh"
+#include "logger.hh"
+#include "save_buffer.hh"
 
 #include "script_object.hpp"
+#include "company_base.h"
+#include "saveload/saveload.h"
+
+#include <cstring>
+#include <vector>
 
 
 using namespace EmpireAI;
 
 
+/// Return the AI of a company, or nullptr if the company isn't run by an EmpireAI on this machine.
+static AI* get_empire_ai(CompanyID company)
+{
+	Company* c = Company::GetIfValid(company);
+
+	if(c == nullptr || c->ai_instance == nullptr || c->ai_info == nullptr || strcmp(c->ai_info->GetName(), "EmpireAI") != 0)
+	{
+		return nullptr;
+	}
+
+	return (AI*)c->ai_instance;
+}
+
+
 AI::AI()
+: m_decision_engine(new DecisionEngine())
+{
+}
+
+
+AI::~AI()
 {
 }
 
@@ -15,5 +43,63 @@ void AI::game_loop()
 {
 	ScriptObject::ActiveInstance active(this);
 
-	m_decision_engine.update();
+	m_decision_engine->update();
+}
+
+
+/// Write the work in progress of every EmpireAI into its own chunk of the savegame, one element per company.
+/**
+ * The chunk is kept apart from the AIPL chunk of the scripts, so that savegames without it still load. Companies
+ * run by other AIs, and every company on clients of a network game, which don't run AIs, write no element.
+ */
+void AI::save_chunk()
+{
+	for(CompanyID company = COMPANY_FIRST; company < MAX_COMPANIES; company++)
+	{
+		AI* empire_ai = get_empire_ai(company);
+
+		if(empire_ai == nullptr)
+		{
+			continue;
+		}
+
+		SaveWriter writer;
+		empire_ai->m_decision_engine->save(writer);
+
+		std::vector<uint8> data = writer.data();
+
+		SlSetArrayIndex(company);
+		SlArray(data.data(), data.size(), SLE_UINT8);
+	}
+}
+
+
+/// Read the elements written by save_chunk(), and let the AI of each company carry on where it stopped.
+/**
+ * Called after the AIPL chunk, so the AIs have already been started. Each element is read even if its company has
+ * no EmpireAI to hand it to, so that the rest of the savegame can be read.
+ */
+void AI::load_chunk()
+{
+	int index;
+
+	while((index = SlIterateArray()) != -1)
+	{
+		std::vector<uint8> data(SlGetFieldLength());
+		SlArray(data.data(), data.size(), SLE_UINT8);
+
+		AI* empire_ai = get_empire_ai((CompanyID)index);
+
+		if(empire_ai == nullptr)
+		{
+			continue;
+		}
+
+		SaveReader reader(data);
+
+		if(!empire_ai->m_decision_engine->load(reader))
+		{
+			Logger::warning("Saved routes couldn't be loaded, starting over");
+		}
+	}
 }
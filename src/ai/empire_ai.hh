@@ -4,21 +4,34 @@
 #include "stdafx.h"
 #include "../../../ai_instance.hpp"
 
-#include "decision_engine.hh"
+#include <memory>
 
 namespace EmpireAI
 {
+	class DecisionEngine;
+
+
+	/**
+	 * The AI of one company. Each company has its own DecisionEngine, so several can run side by side.
+	 *
+	 * This header is included by OpenTTD, which is built as an older C++ standard, so the DecisionEngine and its
+	 * C++20 coroutines are kept out of it.
+	 */
 	class AI : public AIInstance
 	{
 	public:
 
         AI();
+		~AI();
 
 		void game_loop();
 
+		static void save_chunk();
+		static void load_chunk();
+
 	private:
 
-		DecisionEngine m_decision_engine;
+		std::unique_ptr<DecisionEngine> m_decision_engine;
 	};
 };
 
@@ -0,0 +1,334 @@
+/// \file
+#include "landmark_map.hh"
+#include "connectivity_cache.hh"
+#include "openttd_functions.hh"
+
+#include "map_func.h"
+
+using namespace EmpireAI;
+
+
+LandmarkMap* LandmarkMap::m_instance = nullptr;
+
+
+LandmarkMap::LandmarkMap()
+: m_tables_may_overestimate(false), m_map_changed(true), m_building(false), m_placing_first_landmark(false), m_map_size(0), m_landmark_count(0),
+  m_block_shift(0), m_landmark(0), m_next_tables_may_overestimate(false), m_scan_tile(0), m_scanned_tile_count(0),
+  m_queue_head(0), m_next_landmark(INVALID_TILE), m_next_landmark_distance(0)
+{
+}
+
+
+LandmarkMap* LandmarkMap::instance()
+{
+    if(m_instance == nullptr)
+    {
+        m_instance = new LandmarkMap();
+    }
+
+    m_instance->reset_if_map_changed();
+    return m_instance;
+}
+
+
+/// Free the tables once no AI needs it any more. The next call to instance() starts an empty one.
+void LandmarkMap::destroy()
+{
+    delete m_instance;
+    m_instance = nullptr;
+}
+
+
+/// Carry on building the next tables, starting a new build if the map has changed since the last one.
+/**
+ * Must be called on the game thread. A full build takes about MapSize() / max_tile_count calls per landmark,
+ * and as many again to place the first landmark.
+ * @param[in] max_tile_count The maximum amount of tiles to search from before returning.
+ * @return True if new tables were completed during this call.
+ */
+bool LandmarkMap::refresh(const uint32 max_tile_count)
+{
+    if(!m_building)
+    {
+        if(!m_map_changed)
+        {
+            return false;
+        }
+
+        start_build();
+
+        if(!m_building)
+        {
+            return false;
+        }
+    }
+
+    for(uint32 tile_count = 0; tile_count < max_tile_count; tile_count++)
+    {
+        if(m_queue_head < m_queue.size())
+        {
+            search_step();
+            continue;
+        }
+
+        // Nothing has been searched from yet until the first landmark is found
+        if(m_queue.empty())
+        {
+            if(!scan_for_first_landmark())
+            {
+                publish();
+                return true;
+            }
+
+            continue;
+        }
+
+        // The first search only finds the tile furthest from the middle, which is where the first landmark goes
+        if(m_placing_first_landmark)
+        {
+            m_placing_first_landmark = false;
+            start_search(m_next_landmark);
+            continue;
+        }
+
+        // The distances from the current landmark are complete. Stop early if every tile is a landmark already.
+        m_landmark++;
+
+        if(m_landmark == m_landmark_count || m_next_landmark_distance == 0)
+        {
+            publish();
+            return true;
+        }
+
+        start_search(m_next_landmark);
+    }
+
+    return false;
+}
+
+
+/// Build the tables again once the map has changed, since tiles may have been built on or cleared.
+/**
+ * Until then, tables that may have become too high for the tile are no longer handed out.
+ * @param[in] tile The tile that has changed.
+ */
+void LandmarkMap::tile_changed(TileIndex tile)
+{
+    m_map_changed = true;
+
+    if(opens_shortcut(tile, m_reached))
+    {
+        m_tables_may_overestimate = true;
+    }
+
+    if(m_building && opens_shortcut(tile, m_next_reached))
+    {
+        m_next_tables_may_overestimate = true;
+    }
+}
+
+
+/// Check whether a changed tile may shorten the distances of tables that have reached the given tiles.
+/**
+ * Any route the tables don't know about leaves the reached tiles through a tile next to them that wasn't reached,
+ * so that tile must have started supporting roads since. A tile that was reached already supported roads then.
+ * @param[in] tile The tile that has changed.
+ * @param[in] reached The tiles reached by the tables, one per tile of the map, or empty if there are no tables.
+ * @return True if the tile supports roads now, wasn't reached, and is next to a tile that was.
+ */
+bool LandmarkMap::opens_shortcut(const TileIndex tile, const std::vector<bool>& reached)
+{
+    // The ConnectivityCache may not have been told about the change yet, so the tile is read from the game
+    if(tile >= reached.size() || reached[tile] || !EmpireAI::tile_supports_road(tile))
+    {
+        return false;
+    }
+
+    const int32 row = (int32)MapSizeX();
+    const int32 offsets[] = {1, -1, row, -row};
+
+    for(const int32 offset : offsets)
+    {
+        // Tiles past either end of the map wrap around to large indexes
+        const TileIndex adjacent_tile = tile + offset;
+
+        if(adjacent_tile < reached.size() && reached[adjacent_tile])
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/// Discard the tables if a game with a different map size has been started.
+void LandmarkMap::reset_if_map_changed()
+{
+    if(m_map_size == MapSize())
+    {
+        return;
+    }
+
+    m_map_size = MapSize();
+    m_tables.reset();
+    m_reached.clear();
+    m_tables_may_overestimate = false;
+    m_building = false;
+    m_map_changed = true;
+}
+
+
+/// Start building new tables, with blocks just large enough to fit enough landmarks into the memory allowed for them.
+void LandmarkMap::start_build()
+{
+    m_map_changed = false;
+    m_block_shift = 0;
+
+    const uint32 max_block_shift = std::min(MapLogX(), MapLogY());
+
+    while(m_block_shift < max_block_shift &&
+        ((size_t)m_map_size >> (2 * m_block_shift)) * MIN_LANDMARK_COUNT * sizeof(LandmarkTables::Range) > MAX_TABLE_BYTES)
+    {
+        m_block_shift++;
+    }
+
+    const size_t block_count = (size_t)m_map_size >> (2 * m_block_shift);
+    m_landmark_count = std::min<size_t>(MAX_LANDMARK_COUNT, MAX_TABLE_BYTES / (block_count * sizeof(LandmarkTables::Range)));
+
+    if(m_landmark_count == 0)
+    {
+        return;
+    }
+
+    m_building = true;
+    m_placing_first_landmark = true;
+    m_next_reached.assign(m_map_size, false);
+    m_next_tables_may_overestimate = false;
+    m_landmark = 0;
+    m_next_ranges.assign(block_count * m_landmark_count, LandmarkTables::Range());
+
+    // Start looking for the first landmark in the middle of the map, where land is most likely
+    m_scan_tile = TileXY(MapSizeX() / 2, MapSizeY() / 2);
+    m_scanned_tile_count = 0;
+    m_queue.clear();
+    m_queue_head = 0;
+}
+
+
+/// Check the next tile for the first landmark, and start searching from it if it supports roads.
+/**
+ * @return False if every tile has been checked, and none of them supports roads.
+ */
+bool LandmarkMap::scan_for_first_landmark()
+{
+    if(m_scanned_tile_count == m_map_size)
+    {
+        return false;
+    }
+
+    const TileIndex tile = m_scan_tile;
+    m_scan_tile = (m_scan_tile + 1) % m_map_size;
+    m_scanned_tile_count++;
+
+    if(ConnectivityCache::instance()->tile_supports_road(tile))
+    {
+        start_search(tile);
+    }
+
+    return true;
+}
+
+
+/// Start finding the distances from the current landmark.
+void LandmarkMap::start_search(const TileIndex landmark_tile)
+{
+    m_queue.clear();
+    m_queue_head = 0;
+    m_distances.assign(m_map_size, (uint16)LandmarkTables::UNREACHABLE);
+    m_next_landmark = landmark_tile;
+    m_next_landmark_distance = 0;
+
+    reach_tile(landmark_tile, 0);
+}
+
+
+/// Search from the next tile in the queue, reaching the tiles next to it that support roads.
+void LandmarkMap::search_step()
+{
+    const TileIndex tile = m_queue[m_queue_head++];
+    const uint32 distance = m_distances[tile];
+
+    ConnectivityCache* connectivity = ConnectivityCache::instance();
+    const int32 row = (int32)MapSizeX();
+    const int32 offsets[] = {1, -1, row, -row};
+
+    for(const int32 offset : offsets)
+    {
+        // Tiles past either end of the map wrap around to large indexes. The border tiles don't support roads.
+        const TileIndex adjacent_tile = tile + offset;
+
+        if(adjacent_tile >= m_map_size ||
+            m_distances[adjacent_tile] != LandmarkTables::UNREACHABLE ||
+            !connectivity->tile_supports_road(adjacent_tile))
+        {
+            continue;
+        }
+
+        reach_tile(adjacent_tile, distance + 1);
+    }
+}
+
+
+/// Record the distance of a tile from the current landmark, and queue it to search from.
+/**
+ * The range of the block of the tile is widened to take the distance in. The tile is also considered for the next
+ * landmark, by its distance from the nearest landmark so far. The earlier landmarks only have the nearest distance
+ * of the block, which is close enough to spread the landmarks out.
+ * @param[in] tile The tile that has been reached.
+ * @param[in] distance Its distance from the current landmark.
+ */
+void LandmarkMap::reach_tile(const TileIndex tile, const uint32 distance)
+{
+    // Huge distances are capped, which only makes the bounds lower
+    const uint16 capped_distance = (uint16)std::min<uint32>(distance, LandmarkTables::UNREACHABLE - 1);
+    m_distances[tile] = capped_distance;
+    m_next_reached[tile] = true;
+    m_queue.push_back(tile);
+
+    LandmarkTables::Range* ranges = &m_next_ranges[LandmarkTables::block(tile, m_block_shift) * m_landmark_count];
+
+    if(!m_placing_first_landmark)
+    {
+        ranges[m_landmark].nearest = std::min(ranges[m_landmark].nearest, capped_distance);
+        ranges[m_landmark].furthest = std::max(ranges[m_landmark].furthest, capped_distance);
+    }
+
+    uint32 nearest_distance = capped_distance;
+
+    for(uint32 landmark = 0; landmark < m_landmark; landmark++)
+    {
+        nearest_distance = std::min<uint32>(nearest_distance, ranges[landmark].nearest);
+    }
+
+    if(nearest_distance > m_next_landmark_distance)
+    {
+        m_next_landmark = tile;
+        m_next_landmark_distance = nearest_distance;
+    }
+}
+
+
+/// Swap the tables that have just been built in for the old ones, and free the memory used to build them.
+void LandmarkMap::publish()
+{
+    m_tables = std::make_shared<const LandmarkTables>(m_landmark_count, m_block_shift, std::move(m_next_ranges));
+    m_next_ranges = std::vector<LandmarkTables::Range>();
+    m_reached.swap(m_next_reached);
+    std::vector<bool>().swap(m_next_reached);
+    m_tables_may_overestimate = m_next_tables_may_overestimate;
+    std::vector<uint16>().swap(m_distances);
+    std::vector<TileIndex>().swap(m_queue);
+    m_queue_head = 0;
+    m_building = false;
+}
@@ -0,0 +1,198 @@
+/// \file
+#ifndef LANDMARK_MAP_HH
+#define LANDMARK_MAP_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "map_func.h"
+#include "map_change_listener.hh"
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Road distances from a few landmark tiles to every tile of the map, for the ALT heuristic.
+     *
+     * By the triangle inequality, the road distance between two tiles is at least the difference of their
+     * distances to any landmark. Unlike the Manhattan distance, this bound knows about water and other obstacles
+     * between the tiles, so a search guided by it explores far fewer tiles around them. The tables are never
+     * changed once built, so they can be shared with searches on worker threads.
+     *
+     * To fit large maps, the tables may keep one range of distances per square block of tiles rather than one
+     * distance per tile. Each range holds the nearest and furthest distance of the tiles of the block, so the
+     * bound still never overestimates. It is only lower by the spread of the distances within the blocks.
+     */
+    class LandmarkTables
+    {
+    public:
+
+        /// Distance of a tile that can't be reached from a landmark.
+        static const uint16 UNREACHABLE = UINT16_MAX;
+
+        /**
+         * Distances of the tiles of a block from one landmark.
+         */
+        struct Range
+        {
+            uint16 nearest = UNREACHABLE; ///< Distance of the nearest tile of the block, or UNREACHABLE.
+            uint16 furthest = 0;          ///< Distance of the furthest tile of the block that can be reached.
+        };
+
+        /**
+         * @param[in] landmark_count Number of landmarks.
+         * @param[in] block_shift Blocks are 1 << block_shift tiles wide and high.
+         * @param[in] ranges The ranges of each block from every landmark, one block after another.
+         */
+        LandmarkTables(const uint32 landmark_count, const uint32 block_shift, std::vector<Range>&& ranges)
+        : m_landmark_count(landmark_count), m_block_shift(block_shift), m_ranges(std::move(ranges))
+        {}
+
+        /// Return the index of the block a tile belongs to.
+        static size_t block(const TileIndex tile, const uint32 block_shift)
+        {
+            return (size_t)(TileY(tile) >> block_shift) * (MapSizeX() >> block_shift) + (TileX(tile) >> block_shift);
+        }
+
+        /// Return the distances from every landmark to the block of a tile.
+        const Range* distances(const TileIndex tile) const
+        {
+            return &m_ranges[block(tile, m_block_shift) * m_landmark_count];
+        }
+
+        /// Return a lower bound of the road distance from a tile to the tile whose distances are given.
+        /**
+         * Landmarks that can't reach both blocks say nothing about the distance between them, and are skipped.
+         * @param[in] tile The tile to find the bound for.
+         * @param[in] target_distances The distances of the other tile, as returned by distances().
+         * @return The bound, or 0 if no landmark can reach both tiles.
+         */
+        uint32 lower_bound(const TileIndex tile, const Range* target_distances) const
+        {
+            const Range* tile_distances = distances(tile);
+            int32 bound = 0;
+
+            for(uint32 landmark = 0; landmark < m_landmark_count; landmark++)
+            {
+                const Range& tile_range = tile_distances[landmark];
+                const Range& target_range = target_distances[landmark];
+
+                if(tile_range.nearest == UNREACHABLE || target_range.nearest == UNREACHABLE)
+                {
+                    continue;
+                }
+
+                bound = std::max(bound, (int32)tile_range.nearest - (int32)target_range.furthest);
+                bound = std::max(bound, (int32)target_range.nearest - (int32)tile_range.furthest);
+            }
+
+            return (uint32)bound;
+        }
+
+        /// Return the memory used by the tables, in bytes.
+        size_t size_in_bytes() const
+        {
+            return m_ranges.size() * sizeof(Range);
+        }
+
+    private:
+
+        uint32 m_landmark_count;
+        uint32 m_block_shift;
+        std::vector<Range> m_ranges; ///< The ranges of each block from every landmark, one block after another.
+    };
+
+
+    /**
+     * Builds the LandmarkTables of the map in the background, a few tiles per tick.
+     *
+     * The first landmark is the tile furthest by road from the first tile that supports roads from the middle of
+     * the map onwards. Each further landmark is the tile furthest by road from all landmarks before it, which
+     * spreads them around the edges of the land that can be reached. Distances are found with a breadth-first search over the tiles that
+     * support roads, ignoring slopes and the shape of roads already built. This allows more routes than a Path
+     * does, so the distances never overestimate.
+     *
+     * The map changes without telling anyone, so the tables are built again whenever a change has been reported
+     * since the last build started. The new tables are built next to the old ones and swapped in once complete.
+     * A tile that stops supporting roads only makes distances longer, so the tables still never overestimate. A
+     * tile next to the reached tiles that starts supporting roads may be a shortcut the tables don't know about,
+     * so once one is reported, tables() hands out no tables until the next build is complete. Searches keep the
+     * tables they started with, and may then miss a shortcut opened after they started, as they do for tiles they
+     * have already searched past. The tables take four bytes per landmark and block, so on large maps fewer
+     * landmarks are used, and on the largest the blocks are made larger as well.
+     */
+    class LandmarkMap : public MapChangeListener
+    {
+    public:
+
+        /// Most landmarks used on maps small enough to have room for them.
+        static const uint32 MAX_LANDMARK_COUNT = 8;
+
+        /// Blocks are made larger until at least this many landmarks fit. A few landmarks on every tile guide
+        /// the search better than more landmarks on coarser blocks.
+        static const uint32 MIN_LANDMARK_COUNT = 4;
+
+        static LandmarkMap* instance();
+        static void destroy();
+
+        bool refresh(const uint32 max_tile_count);
+
+        /// The most recently built tables, or nullptr until the first build is complete or while they may overestimate.
+        std::shared_ptr<const LandmarkTables> tables() const
+        {
+            return m_tables_may_overestimate ? nullptr : m_tables;
+        }
+
+        void tile_changed(TileIndex tile) override;
+
+    private:
+
+        LandmarkMap();
+
+        void reset_if_map_changed();
+        void start_build();
+        bool scan_for_first_landmark();
+        void start_search(const TileIndex landmark_tile);
+        void search_step();
+        void reach_tile(const TileIndex tile, const uint32 distance);
+        static bool opens_shortcut(const TileIndex tile, const std::vector<bool>& reached);
+        void publish();
+
+        /// Most memory a set of tables may use. The tables being built need as much again, and two bytes per tile besides.
+        /// Whether each tile has been reached takes a bit per tile for either set.
+        static const size_t MAX_TABLE_BYTES = 16 * 1024 * 1024;
+
+        static LandmarkMap* m_instance;
+
+        std::shared_ptr<const LandmarkTables> m_tables;
+        std::vector<bool> m_reached;        ///< Tiles that were reached when m_tables were built.
+        bool m_tables_may_overestimate;     ///< True once a tile next to m_reached has started supporting roads.
+
+        bool m_map_changed;         ///< True if a change has been reported since the last build started.
+        bool m_building;            ///< True while the next tables are being built.
+        bool m_placing_first_landmark; ///< True while searching from the middle of the map for the first landmark.
+        uint32 m_map_size;
+
+        uint32 m_landmark_count;    ///< Landmarks of the tables being built.
+        uint32 m_block_shift;       ///< Blocks of the tables being built are 1 << m_block_shift tiles wide.
+        uint32 m_landmark;          ///< The landmark whose distances are being found.
+        std::vector<LandmarkTables::Range> m_next_ranges; ///< The tables being built, in the layout of LandmarkTables.
+        std::vector<uint16> m_distances; ///< Distance of each tile from the current landmark, while it is searched.
+        std::vector<bool> m_next_reached; ///< Tiles reached by any landmark of the tables being built so far.
+        bool m_next_tables_may_overestimate; ///< True once a tile next to m_next_reached has started supporting roads.
+
+        TileIndex m_scan_tile;      ///< Next tile to check for the first landmark.
+        uint32 m_scanned_tile_count;
+        std::vector<TileIndex> m_queue; ///< Tiles reached by the search, in order of distance.
+        size_t m_queue_head;        ///< The next tile of the queue to search from.
+
+        TileIndex m_next_landmark;  ///< The tile furthest from the landmarks so far, found during the search.
+        uint32 m_next_landmark_distance;
+    };
+}
+
+
+#endif // LANDMARK_MAP_HH
@@ -0,0 +1,182 @@
+/// \file
+#include "logger.hh"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace EmpireAI;
+
+
+Logger* Logger::m_instance = nullptr;
+
+
+Logger::Logger()
+: m_enqueue_position(0), m_dequeue_position(0), m_dropped_count(0), m_level(LOG_INFO), m_stopping(false),
+  m_stopped(false)
+{
+    // A slot is free for the producer whose position matches its sequence
+    for(size_t index = 0; index < CAPACITY; index++)
+    {
+        m_slots[index].sequence.store(index, std::memory_order_relaxed);
+    }
+
+    m_thread = std::thread(&Logger::run, this);
+}
+
+
+Logger* Logger::instance()
+{
+    if(m_instance == nullptr)
+    {
+        m_instance = new Logger();
+        std::atexit(&Logger::shutdown);
+    }
+
+    return m_instance;
+}
+
+
+/// Add a message to the log without waiting.
+/**
+ * Messages longer than a slot are cut short. May be called from any thread, once instance() has been called on
+ * the game thread.
+ * @param[in] level The importance of the message.
+ * @param[in] message The text of the message, without a line break.
+ * @return False if the message was dropped because the buffer was full.
+ */
+bool Logger::log(const Level level, const char* message)
+{
+    if(level < m_level.load(std::memory_order_relaxed))
+    {
+        return true;
+    }
+
+    // Once the thread has gone, at exit, there is nothing left to wait for
+    if(m_stopped.load(std::memory_order_acquire))
+    {
+        write(level, message);
+        std::fflush(stdout);
+        return true;
+    }
+
+    size_t position = m_enqueue_position.load(std::memory_order_relaxed);
+    Slot* slot;
+
+    // Claim the slot at the enqueue position, unless the thread hasn't written the message that was in it yet
+    while(true)
+    {
+        slot = &m_slots[position & (CAPACITY - 1)];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+        if(difference == 0)
+        {
+            if(m_enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if(difference < 0)
+        {
+            m_dropped_count.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else
+        {
+            // Another producer claimed the slot first
+            position = m_enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->level = level;
+    std::strncpy(slot->message, message, sizeof(slot->message) - 1);
+    slot->message[sizeof(slot->message) - 1] = '\0';
+
+    // Hand the slot to the thread
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+
+/// Stop the thread once it has written every message. Called at exit.
+void Logger::shutdown()
+{
+    m_instance->m_stopping.store(true, std::memory_order_release);
+    m_instance->m_thread.join();
+    m_instance->m_stopped.store(true, std::memory_order_release);
+}
+
+
+/// Write messages as they arrive, until asked to stop. Runs on the background thread.
+void Logger::run()
+{
+    while(true)
+    {
+        // Every message added before the request to stop is written before the thread stops
+        const bool stopping = m_stopping.load(std::memory_order_acquire);
+        bool written = false;
+
+        while(write_next())
+        {
+            written = true;
+        }
+
+        const uint32 dropped_count = m_dropped_count.exchange(0, std::memory_order_relaxed);
+
+        if(dropped_count > 0)
+        {
+            char message[64];
+            std::snprintf(message, sizeof(message), "%u log messages dropped", dropped_count);
+            write(LOG_WARNING, message);
+            written = true;
+        }
+
+        if(written)
+        {
+            std::fflush(stdout);
+        }
+
+        if(stopping)
+        {
+            return;
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(IDLE_MS));
+    }
+}
+
+
+/// Write the next message, if it has been added.
+/**
+ * Messages are written in the order their slots were claimed, so a producer that has claimed a slot but not
+ * filled it yet holds back the messages after it.
+ * @return True if a message was written.
+ */
+bool Logger::write_next()
+{
+    Slot& slot = m_slots[m_dequeue_position & (CAPACITY - 1)];
+
+    if(slot.sequence.load(std::memory_order_acquire) != m_dequeue_position + 1)
+    {
+        return false;
+    }
+
+    write(slot.level, slot.message);
+
+    // Free the slot for the producer that comes round to it next
+    slot.sequence.store(m_dequeue_position + CAPACITY, std::memory_order_release);
+    m_dequeue_position++;
+
+    return true;
+}
+
+
+/// Format a message and write it to stdout.
+void Logger::write(const Level level, const char* message)
+{
+    static const char* const level_names[] = {"debug", "info", "warning", "error"};
+
+    std::fprintf(stdout, "[%s] %s\n", level_names[level], message);
+}
@@ -0,0 +1,114 @@
+/// \file
+#ifndef LOGGER_HH
+#define LOGGER_HH
+
+
+#include "stdafx.h"
+#include <array>
+#include <atomic>
+#include <thread>
+
+
+namespace EmpireAI
+{
+    /**
+     * Log that writes to stdout from a background thread, so that the game loop never waits for the output.
+     *
+     * Messages go into a fixed-size lock-free ring buffer. Adding one copies the text into a free slot and never
+     * blocks. If the buffer is full the message is dropped, and the number of dropped messages is logged once
+     * there is room again. The background thread writes the messages in the order they were added, with their
+     * level, and flushes after each batch. Whatever is still in the buffer is written when the process exits.
+     */
+    class Logger
+    {
+    public:
+
+        /**
+         * Enum of the log levels, from least to most important.
+         */
+        enum Level
+        {
+            LOG_DEBUG,
+            LOG_INFO,
+            LOG_WARNING,
+            LOG_ERROR
+        };
+
+        static Logger* instance();
+
+        /// Log a message at the LOG_DEBUG level.
+        static void debug(const char* message)
+        {
+            instance()->log(LOG_DEBUG, message);
+        }
+
+        /// Log a message at the LOG_INFO level.
+        static void info(const char* message)
+        {
+            instance()->log(LOG_INFO, message);
+        }
+
+        /// Log a message at the LOG_WARNING level.
+        static void warning(const char* message)
+        {
+            instance()->log(LOG_WARNING, message);
+        }
+
+        /// Log a message at the LOG_ERROR level.
+        static void error(const char* message)
+        {
+            instance()->log(LOG_ERROR, message);
+        }
+
+        bool log(const Level level, const char* message);
+
+        /// Set the least important level that is logged. Messages below it are discarded straight away.
+        void set_level(const Level level)
+        {
+            m_level = level;
+        }
+
+    private:
+
+        /**
+         * One message in the ring buffer.
+         */
+        struct Slot
+        {
+            /// Tells producers and the consumer whose turn it is to use the slot. See log() and write_next().
+            std::atomic<size_t> sequence;
+            Level level;
+            char message[128];
+        };
+
+        Logger();
+
+        static void shutdown();
+
+        void run();
+        bool write_next();
+        void write(const Level level, const char* message);
+
+        /// Number of slots in the ring buffer, a power of two
+        static const size_t CAPACITY = 1024;
+
+        /// Time the background thread sleeps when the buffer is empty
+        static const uint32 IDLE_MS = 10;
+
+        static Logger* m_instance;
+
+        std::array<Slot, CAPACITY> m_slots;
+        std::atomic<size_t> m_enqueue_position; ///< Position of the next slot to be claimed by a producer.
+        size_t m_dequeue_position;              ///< Position of the next slot to be written. Only used by the thread.
+
+        std::atomic<uint32> m_dropped_count;    ///< Messages dropped because the buffer was full.
+        std::atomic<Level> m_level;
+
+        std::atomic<bool> m_stopping;           ///< Tells the thread to write what is left and stop.
+        std::atomic<bool> m_stopped;            ///< True once the thread has stopped, and messages are written directly.
+        std::thread m_thread;
+    };
+}
+
+
+#endif // LOGGER_HH
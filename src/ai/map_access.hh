@@ -0,0 +1,157 @@
+/// \file
+#ifndef MAP_ACCESS_HH
+#define MAP_ACCESS_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "map_func.h"
+#include "connectivity_cache.hh"
+#include "map_snapshot.hh"
+#include "openttd_functions.hh"
+
+#include "script_map.hpp"
+
+
+namespace EmpireAI
+{
+    /**
+     * The part of a map access policy that finds tiles and distances with plain index arithmetic.
+     *
+     * The size of the map is read once, when the policy is created, so nothing here reads the map afterwards.
+     */
+    class TileArithmetic
+    {
+    public:
+
+        TileArithmetic()
+        : m_row_size((int32)MapSizeX()), m_map_size(MapSize())
+        {}
+
+        /// Return the tile at a fixed offset from a tile. It may lie off the edge of the map.
+        template<int8 X, int8 Y>
+        TileIndex adjacent_tile(const TileIndex tile) const
+        {
+            // X and Y are known at compile time, so only the row size is read at run time
+            return tile + X + Y * m_row_size;
+        }
+
+        /// Return true if a tile lies on the map.
+        bool is_valid_tile(const TileIndex tile) const
+        {
+            return tile < m_map_size;
+        }
+
+        /// Return the Manhattan distance between two tiles.
+        uint32 distance(const TileIndex tile_1, const TileIndex tile_2) const
+        {
+            const uint32 x_1 = TileX(tile_1);
+            const uint32 x_2 = TileX(tile_2);
+            const uint32 y_1 = TileY(tile_1);
+            const uint32 y_2 = TileY(tile_2);
+
+            return (x_1 > x_2 ? x_1 - x_2 : x_2 - x_1) + (y_1 > y_2 ? y_1 - y_2 : y_2 - y_1);
+        }
+
+    private:
+
+        int32 m_row_size;   ///< Offset between a tile and the tile below it, fixed for the lifetime of a map.
+        uint32 m_map_size;
+    };
+
+
+    /**
+     * Map access policy for BasicPath that reads the map directly.
+     *
+     * Adjacent tiles are found with plain index arithmetic on OpenTTD's map size, and road connectivity comes
+     * from the ConnectivityCache, whose cached results are read inline. Every function is inline, so the inner
+     * loop of a search compiles down to array lookups. The caller is responsible for only passing valid tiles.
+     * The ConnectivityCache is filled in as it is read, so searches using this policy must run on the game thread.
+     */
+    class DirectMapAccess : public TileArithmetic
+    {
+    public:
+
+        DirectMapAccess()
+        : m_connectivity(ConnectivityCache::instance())
+        {}
+
+        /// Determine whether a road can be built on a tile, connecting the two tiles on either side of it.
+        bool can_build_road_through(const TileIndex tile, const TileIndex from, const TileIndex to) const
+        {
+            return m_connectivity->can_build_road_through(tile, from, to);
+        }
+
+    private:
+
+        ConnectivityCache* m_connectivity;
+    };
+
+
+    /**
+     * Map access policy for BasicPath that reads a MapSnapshot instead of the map.
+     *
+     * The snapshot is the only data it can reach, and a complete snapshot never changes, so a search using this
+     * policy can run on a worker thread without sharing anything with the caches of the game thread. See AsyncPath.
+     */
+    class SnapshotMapAccess : public TileArithmetic
+    {
+    public:
+
+        /// @param[in] snapshot The snapshot to read. It must stay alive for as long as the search reads it.
+        explicit SnapshotMapAccess(const MapSnapshot& snapshot)
+        : m_snapshot(&snapshot)
+        {}
+
+        /// Determine whether a road can be built on a tile, connecting the two tiles on either side of it.
+        bool can_build_road_through(const TileIndex tile, const TileIndex from, const TileIndex to) const
+        {
+            return m_snapshot->can_build_road_through(tile, from, to);
+        }
+
+    private:
+
+        const MapSnapshot* m_snapshot;
+    };
+
+
+    /**
+     * Map access policy for BasicPath that goes through the Script API for everything.
+     *
+     * Every tile is checked by ScriptMap, and road connectivity is asked of the game on every step without any
+     * caching. This is much slower than DirectMapAccess, but it is the reference behaviour that the cached
+     * results are checked against when testing.
+     */
+    class ScriptMapAccess
+    {
+    public:
+
+        /// Return the tile at a fixed offset from a tile. It may lie off the edge of the map.
+        template<int8 X, int8 Y>
+        TileIndex adjacent_tile(const TileIndex tile) const
+        {
+            return tile + ScriptMap::GetTileIndex(X, Y);
+        }
+
+        /// Return true if a tile lies on the map.
+        bool is_valid_tile(const TileIndex tile) const
+        {
+            return ScriptMap::IsValidTile(tile);
+        }
+
+        /// Return the Manhattan distance between two tiles.
+        uint32 distance(const TileIndex tile_1, const TileIndex tile_2) const
+        {
+            return ScriptMap::DistanceManhattan(tile_1, tile_2);
+        }
+
+        /// Determine whether a road can be built on a tile, connecting the two tiles on either side of it.
+        bool can_build_road_through(const TileIndex tile, const TileIndex from, const TileIndex to) const
+        {
+            return EmpireAI::can_build_road_through(tile, from, to);
+        }
+    };
+}
+
+
+#endif // MAP_ACCESS_HH
@@ -0,0 +1,60 @@
+/// \file
+#include "map_change_listener.hh"
+
+#include "map_func.h"
+
+#include <algorithm>
+
+using namespace EmpireAI;
+
+
+MapChangeListener::MapChangeListener()
+{
+    listeners().push_back(this);
+}
+
+
+MapChangeListener::~MapChangeListener()
+{
+    std::vector<MapChangeListener*>& all_listeners = listeners();
+    all_listeners.erase(std::remove(all_listeners.begin(), all_listeners.end(), this), all_listeners.end());
+}
+
+
+/// Tell every listener that a tile has changed.
+/**
+ * @param[in] tile The tile that changed.
+ */
+void MapChangeListener::notify_tile_changed(TileIndex tile)
+{
+    for(MapChangeListener* listener : listeners())
+    {
+        listener->tile_changed(tile);
+    }
+}
+
+
+/// Tell every listener that all tiles on a straight line have changed.
+/**
+ * @param[in] start The tile at one end of the line.
+ * @param[in] end The tile at the other end of the line. It must share an x or y coordinate with start.
+ */
+void MapChangeListener::notify_tiles_changed(TileIndex start, TileIndex end)
+{
+    TileIndex first_tile = std::min(start, end);
+    TileIndex last_tile = std::max(start, end);
+    TileIndex step = TileX(start) == TileX(end) ? MapSizeX() : 1;
+
+    for(TileIndex tile = first_tile; tile <= last_tile; tile += step)
+    {
+        notify_tile_changed(tile);
+    }
+}
+
+
+/// The list of registered listeners. Built on first use so that static listeners can register safely.
+std::vector<MapChangeListener*>& MapChangeListener::listeners()
+{
+    static std::vector<MapChangeListener*> all_listeners;
+    return all_listeners;
+}
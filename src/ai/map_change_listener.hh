@@ -0,0 +1,37 @@
+/// \file
+#ifndef MAP_CHANGE_LISTENER_HH
+#define MAP_CHANGE_LISTENER_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Base class for anything that keeps data derived from map tiles and has to be told when a tile changes.
+     * Listeners register themselves on construction and unregister on destruction.
+     */
+    class MapChangeListener
+    {
+    public:
+
+        MapChangeListener();
+        virtual ~MapChangeListener();
+
+        /// Called after the contents of a tile have changed.
+        virtual void tile_changed(TileIndex tile) = 0;
+
+        static void notify_tile_changed(TileIndex tile);
+        static void notify_tiles_changed(TileIndex start, TileIndex end);
+
+    private:
+
+        static std::vector<MapChangeListener*>& listeners();
+    };
+}
+
+
+#endif // MAP_CHANGE_LISTENER_HH
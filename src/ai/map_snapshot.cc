@@ -0,0 +1,83 @@
+/// \file
+#include "map_snapshot.hh"
+#include "openttd_functions.hh"
+
+#include "map_func.h"
+
+using namespace EmpireAI;
+
+
+/// Prepare a snapshot of the clusters of a corridor. Nothing is captured until capture() is called.
+MapSnapshot::MapSnapshot(const Corridor& corridor)
+: m_next_cluster(0), m_next_tile(0)
+{
+    for(uint32 cluster_index = 0; cluster_index < corridor.cluster_count(); cluster_index++)
+    {
+        if(corridor.contains_cluster(cluster_index))
+        {
+            m_cluster_indices.push_back(cluster_index);
+        }
+    }
+
+    m_tiles.fit_to_map();
+}
+
+
+/// Capture more of the snapshot. Must be called on the game thread.
+/**
+ * Tiles are read from the live map, not the ConnectivityCache, so that the snapshot doesn't inherit tiles the
+ * cache hasn't noticed have changed, and shares nothing with it once captured.
+ * @param[in] max_tile_count The maximum amount of tiles to capture before returning.
+ * @return True once the snapshot is complete.
+ */
+bool MapSnapshot::capture(const uint32 max_tile_count)
+{
+    for(uint32 tile_count = 0; tile_count < max_tile_count && !complete(); tile_count++)
+    {
+        const TileIndex origin = Corridor::cluster_origin(m_cluster_indices[m_next_cluster]);
+        const TileIndex tile_index = origin + TileDiffXY(m_next_tile & (Corridor::CLUSTER_SIZE - 1), m_next_tile >> Corridor::CLUSTER_BITS);
+
+        Tile& tile = m_tiles[tile_index];
+        tile.supports_road = tile_supports_road(tile_index);
+
+        // The slope and road only matter on tiles a road can use
+        if(tile.supports_road)
+        {
+            tile.slope = get_tile_slope(tile_index);
+            tile.road_bits = get_road_bits(tile_index);
+        }
+
+        tile.captured = true;
+
+        m_next_tile++;
+        if(m_next_tile == Corridor::CLUSTER_SIZE * Corridor::CLUSTER_SIZE)
+        {
+            m_next_tile = 0;
+            m_next_cluster++;
+        }
+    }
+
+    return complete();
+}
+
+
+/// Determine whether a road can be built on a tile, connecting the two tiles on either side of it.
+/**
+ * Gives the same answer as EmpireAI::can_build_road_through() did for the map at the time it was captured.
+ * Safe to call from any thread once the snapshot is complete.
+ * @param[in] tile The tile to be examined.
+ * @param[in] from The tile the road arrives from.
+ * @param[in] to The tile the road continues to.
+ * @return
+ */
+bool MapSnapshot::can_build_road_through(const TileIndex tile, const TileIndex from, const TileIndex to) const
+{
+    const Tile* snapshot_tile = m_tiles.find(tile);
+
+    if(snapshot_tile == nullptr || !snapshot_tile->captured || !snapshot_tile->supports_road)
+    {
+        return false;
+    }
+
+    return can_build_connected_road_parts(snapshot_tile->slope, snapshot_tile->road_bits, from - tile, to - tile);
+}
@@ -0,0 +1,58 @@
+/// \file
+#ifndef MAP_SNAPSHOT_HH
+#define MAP_SNAPSHOT_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "corridor.hh"
+#include "paged_tile_array.hh"
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Read-only copy of the tile data a Path needs to decide where a road can go, taken for the clusters of
+     * a corridor.
+     *
+     * The snapshot is captured on the game thread, a few clusters at a time. Once complete it never touches
+     * the map again, so a search can use it from a worker thread while the game carries on. Tiles outside
+     * the captured clusters can never carry a road.
+     */
+    class MapSnapshot
+    {
+    public:
+
+        explicit MapSnapshot(const Corridor& corridor);
+
+        bool capture(const uint32 max_tile_count);
+
+        /// Return true once every tile of the corridor has been captured.
+        bool complete() const
+        {
+            return m_next_cluster == m_cluster_indices.size();
+        }
+
+        bool can_build_road_through(const TileIndex tile, const TileIndex from, const TileIndex to) const;
+
+    private:
+
+        struct Tile
+        {
+            uint8 slope = 0;
+            uint8 road_bits = 0;
+            bool supports_road = false;
+            bool captured = false; ///< False for tiles outside the captured clusters.
+        };
+
+        std::vector<uint32> m_cluster_indices; ///< The clusters to capture.
+        size_t m_next_cluster;                 ///< Index into m_cluster_indices of the cluster being captured.
+        uint32 m_next_tile;                    ///< Position within that cluster of the next tile to capture.
+
+        PagedTileArray<Tile> m_tiles;
+    };
+}
+
+
+#endif // MAP_SNAPSHOT_HH
@@ -0,0 +1,221 @@
+/// \file
+#include "metrics.hh"
+
+#include <fstream>
+
+using namespace EmpireAI;
+
+
+const char* const Metrics::COUNTER_NAMES[COUNTER_COUNT] = {
+    "script_api_calls",
+    "commands_issued",
+    "commands_failed",
+    "build_commands",
+    "build_commands_failed",
+    "nodes_expanded",
+    "paths_found",
+    "paths_unreachable",
+    "road_plans_checked",
+    "road_plans_rejected",
+    "road_segments_built",
+    "road_segments_failed",
+    "road_repairs",
+    "road_repairs_failed",
+    "stations_built",
+    "stations_failed",
+    "ticks"
+};
+
+const char* const Metrics::HISTOGRAM_NAMES[HISTOGRAM_COUNT] = {
+    "path_nodes_expanded",
+    "path_length",
+    "tick_us"
+};
+
+thread_local Metrics* Metrics::m_active = nullptr;
+std::atomic<uint32> Metrics::m_next_id(0);
+
+
+/// Record one value.
+void Metrics::Histogram::record(const uint64 value)
+{
+    uint32 bucket = 0;
+
+    while(bucket < BUCKET_COUNT - 1 && (value >> bucket) != 0)
+    {
+        bucket++;
+    }
+
+    m_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_sum.fetch_add(value, std::memory_order_relaxed);
+
+    uint64 max = m_max.load(std::memory_order_relaxed);
+
+    while(value > max && !m_max.compare_exchange_weak(max, value, std::memory_order_relaxed))
+    {
+    }
+}
+
+
+/// Write the histogram as a JSON object, with the buckets as pairs of the bucket's upper bound and its count.
+void Metrics::Histogram::write_json(std::ostream& stream) const
+{
+    stream << "{\"count\": " << count() << ", \"sum\": " << sum() << ", \"max\": " << max() << ", \"buckets\": [";
+
+    bool first = true;
+
+    for(uint32 bucket = 0; bucket < BUCKET_COUNT; bucket++)
+    {
+        const uint64 bucket_count = m_buckets[bucket].load(std::memory_order_relaxed);
+
+        // Most buckets are empty, so only the others are written
+        if(bucket_count == 0)
+        {
+            continue;
+        }
+
+        stream << (first ? "" : ", ") << "[" << ((uint64)1 << bucket) << ", " << bucket_count << "]";
+        first = false;
+    }
+
+    stream << "]}";
+}
+
+
+Metrics::Metrics()
+: m_id(m_next_id++), m_dump_interval(0)
+{
+}
+
+
+/// Get the timer of a stage of a DecisionEngine route, creating it the first time the stage is timed.
+/**
+ * @param[in] state_name The name of the state. Only the pointer is compared, so it must be a string literal.
+ * @return The histogram of the time per update() of the state.
+ */
+Metrics::Histogram& Metrics::state_timer(const char* state_name)
+{
+    for(std::pair<const char*, std::unique_ptr<Histogram>>& state_timer : m_state_timers)
+    {
+        if(state_timer.first == state_name)
+        {
+            return *state_timer.second;
+        }
+    }
+
+    m_state_timers.emplace_back(state_name, std::unique_ptr<Histogram>(new Histogram()));
+    return *m_state_timers.back().second;
+}
+
+
+/// Return the value of a counter.
+uint64 Metrics::counter(const Counter id) const
+{
+    return m_counters[id].load(std::memory_order_relaxed);
+}
+
+
+/// Return a histogram.
+const Metrics::Histogram& Metrics::histogram(const HistogramId id) const
+{
+    return m_histograms[id];
+}
+
+
+/// Write the metrics to files every few ticks.
+/**
+ * Each dump replaces the files of the previous one. The files are called file_prefix, followed by a number
+ * that tells AI instances apart, and .json or .csv.
+ * @param[in] tick_count The number of ticks between dumps, or 0 to stop dumping.
+ * @param[in] file_prefix The path and the start of the file names.
+ */
+void Metrics::dump_every(const uint32 tick_count, const std::string& file_prefix)
+{
+    m_dump_interval = tick_count;
+    m_dump_file_prefix = file_prefix;
+}
+
+
+/// Count a tick, and dump the metrics if it is time to.
+void Metrics::tick()
+{
+    const uint64 tick_count = m_counters[TICKS].fetch_add(1, std::memory_order_relaxed) + 1;
+
+    if(m_dump_interval != 0 && tick_count % m_dump_interval == 0)
+    {
+        dump();
+    }
+}
+
+
+/// Write every metric as one JSON object.
+void Metrics::write_json(std::ostream& stream) const
+{
+    stream << "{\n  \"counters\": {";
+
+    for(uint32 index = 0; index < COUNTER_COUNT; index++)
+    {
+        stream << (index == 0 ? "\n" : ",\n") << "    \"" << COUNTER_NAMES[index] << "\": " << counter((Counter)index);
+    }
+
+    stream << "\n  },\n  \"histograms\": {";
+
+    for(uint32 index = 0; index < HISTOGRAM_COUNT; index++)
+    {
+        stream << (index == 0 ? "\n" : ",\n") << "    \"" << HISTOGRAM_NAMES[index] << "\": ";
+        m_histograms[index].write_json(stream);
+    }
+
+    stream << "\n  },\n  \"state_timers_us\": {";
+
+    for(size_t index = 0; index < m_state_timers.size(); index++)
+    {
+        stream << (index == 0 ? "\n" : ",\n") << "    \"" << m_state_timers[index].first << "\": ";
+        m_state_timers[index].second->write_json(stream);
+    }
+
+    stream << "\n  }\n}\n";
+}
+
+
+/// Write every metric as CSV, one line per counter, histogram or state timer.
+/**
+ * The columns are kind, name, value, count, sum and max. Counters only fill in the value, and histograms and
+ * timers leave it empty.
+ */
+void Metrics::write_csv(std::ostream& stream) const
+{
+    stream << "kind,name,value,count,sum,max\n";
+
+    for(uint32 index = 0; index < COUNTER_COUNT; index++)
+    {
+        stream << "counter," << COUNTER_NAMES[index] << "," << counter((Counter)index) << ",,,\n";
+    }
+
+    for(uint32 index = 0; index < HISTOGRAM_COUNT; index++)
+    {
+        const Histogram& histogram = m_histograms[index];
+        stream << "histogram," << HISTOGRAM_NAMES[index] << ",," << histogram.count() << "," << histogram.sum() << ","
+            << histogram.max() << "\n";
+    }
+
+    for(const std::pair<const char*, std::unique_ptr<Histogram>>& state_timer : m_state_timers)
+    {
+        stream << "state_timer_us," << state_timer.first << ",," << state_timer.second->count() << ","
+            << state_timer.second->sum() << "," << state_timer.second->max() << "\n";
+    }
+}
+
+
+/// Write the metrics to the files given to dump_every().
+void Metrics::dump() const
+{
+    const std::string file_name = m_dump_file_prefix + std::to_string(m_id);
+
+    std::ofstream json_file(file_name + ".json");
+    write_json(json_file);
+
+    std::ofstream csv_file(file_name + ".csv");
+    write_csv(csv_file);
+}
@@ -0,0 +1,182 @@
+/// \file
+#ifndef METRICS_HH
+#define METRICS_HH
+
+
+#include "stdafx.h"
+#include <array>
+#include <atomic>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Counters, histograms and state timers of one AI instance.
+     *
+     * Each DecisionEngine owns a Metrics object and makes it active while it runs, so that the code it calls can
+     * record into it with the static count() and record() functions without being handed a pointer. Recording is
+     * a relaxed atomic add, and nothing is recorded while no Metrics object is active, so the metrics can stay on
+     * in normal games. The active object is per thread, so a worker thread has to activate it as well.
+     *
+     * Histograms have one bucket per power of two. The metrics can be written as JSON or CSV at any time, and
+     * to files every few ticks with dump_every().
+     */
+    class Metrics
+    {
+    public:
+
+        /**
+         * Enum of the counters. Keep COUNTER_NAMES in the same order.
+         */
+        enum Counter
+        {
+            SCRIPT_API_CALLS,      ///< Calls into the Script API and the map made by openttd_functions.
+            COMMANDS_ISSUED,       ///< Build commands issued, in test mode or not.
+            COMMANDS_FAILED,       ///< Build commands that failed, in test mode or not.
+            BUILD_COMMANDS,        ///< Build commands issued outside test mode.
+            BUILD_COMMANDS_FAILED, ///< Build commands that failed outside test mode.
+            NODES_EXPANDED,        ///< Nodes expanded by every Path search.
+            PATHS_FOUND,
+            PATHS_UNREACHABLE,
+            ROAD_PLANS_CHECKED,
+            ROAD_PLANS_REJECTED,   ///< Road plans that failed their check and weren't built.
+            ROAD_SEGMENTS_BUILT,
+            ROAD_SEGMENTS_FAILED,
+            ROAD_REPAIRS,          ///< Routes found around tiles that were built on while a road was being built.
+            ROAD_REPAIRS_FAILED,   ///< Repairs that found no route around the tiles that were built on.
+            STATIONS_BUILT,        ///< Pairs of bus stations built with their depot.
+            STATIONS_FAILED,       ///< Routes where no sites were found for the stations, or building them failed.
+            TICKS,
+            COUNTER_COUNT
+        };
+
+        /**
+         * Enum of the histograms. Keep HISTOGRAM_NAMES in the same order.
+         */
+        enum HistogramId
+        {
+            PATH_NODES_EXPANDED, ///< Nodes expanded per finished Path search.
+            PATH_LENGTH,         ///< Tiles per path found.
+            TICK_US,             ///< Time the DecisionEngine used per tick, in microseconds.
+            HISTOGRAM_COUNT
+        };
+
+        /**
+         * Distribution of a value, in buckets of powers of two.
+         */
+        class Histogram
+        {
+        public:
+
+            void record(const uint64 value);
+            void write_json(std::ostream& stream) const;
+
+            uint64 count() const { return m_count.load(std::memory_order_relaxed); }
+            uint64 sum() const { return m_sum.load(std::memory_order_relaxed); }
+            uint64 max() const { return m_max.load(std::memory_order_relaxed); }
+
+        private:
+
+            /// Bucket n holds the values below 2^n that aren't in bucket n - 1
+            static const uint32 BUCKET_COUNT = 41;
+
+            std::array<std::atomic<uint64>, BUCKET_COUNT> m_buckets{};
+            std::atomic<uint64> m_count{0};
+            std::atomic<uint64> m_sum{0};
+            std::atomic<uint64> m_max{0};
+        };
+
+        /**
+         * Makes a Metrics object active on the current thread for as long as it exists.
+         */
+        class Scope
+        {
+        public:
+
+            explicit Scope(Metrics* metrics)
+            : m_previous(m_active)
+            {
+                m_active = metrics;
+            }
+
+            ~Scope()
+            {
+                m_active = m_previous;
+            }
+
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+
+        private:
+
+            Metrics* m_previous;
+        };
+
+        Metrics();
+        Metrics(const Metrics&) = delete;
+        Metrics& operator=(const Metrics&) = delete;
+
+        /// Return the Metrics object active on this thread, or nullptr if there is none.
+        static Metrics* active()
+        {
+            return m_active;
+        }
+
+        /// Add to a counter of the active Metrics object, if there is one.
+        static void count(const Counter counter, const uint64 amount = 1)
+        {
+            if(m_active != nullptr)
+            {
+                m_active->m_counters[counter].fetch_add(amount, std::memory_order_relaxed);
+            }
+        }
+
+        /// Record a value in a histogram of the active Metrics object, if there is one.
+        static void record(const HistogramId histogram, const uint64 value)
+        {
+            if(m_active != nullptr)
+            {
+                m_active->m_histograms[histogram].record(value);
+            }
+        }
+
+        Histogram& state_timer(const char* state_name);
+
+        uint64 counter(const Counter id) const;
+        const Histogram& histogram(const HistogramId id) const;
+
+        void dump_every(const uint32 tick_count, const std::string& file_prefix);
+        void tick();
+
+        void write_json(std::ostream& stream) const;
+        void write_csv(std::ostream& stream) const;
+
+    private:
+
+        void dump() const;
+
+        static const char* const COUNTER_NAMES[COUNTER_COUNT];
+        static const char* const HISTOGRAM_NAMES[HISTOGRAM_COUNT];
+
+        static thread_local Metrics* m_active;
+        static std::atomic<uint32> m_next_id;
+
+        std::array<std::atomic<uint64>, COUNTER_COUNT> m_counters{};
+        std::array<Histogram, HISTOGRAM_COUNT> m_histograms;
+
+        /// Time per step of each stage of a DecisionEngine route, in microseconds, by stage name.
+        std::vector<std::pair<const char*, std::unique_ptr<Histogram>>> m_state_timers;
+
+        uint32 m_id;             ///< Tells the files of several AI instances apart.
+        uint32 m_dump_interval;  ///< Ticks between dumps, or 0 if the metrics are only written on request.
+        std::string m_dump_file_prefix;
+    };
+}
+
+
+#endif // METRICS_HH
@@ -0,0 +1,83 @@
+/// \file
+#include "node_store.hh"
+
+using namespace EmpireAI;
+
+
+std::vector<NodeStore*> NodeStore::m_free_stores;
+std::mutex NodeStore::m_free_stores_mutex;
+
+
+NodeStore::NodeStore()
+: m_generation(0)
+{
+}
+
+
+/// Prepare the store for a new search. Nodes from previous searches are discarded without being cleared.
+void NodeStore::new_search()
+{
+    // A store might be reused in a new game with a different map size
+    if(m_nodes.fit_to_map())
+    {
+        m_generation = 0;
+    }
+
+    m_generation++;
+
+    // Generation 0 marks an empty slot, so after wrapping around, every 255 searches, every node has to be reset once
+    if(m_generation == 0)
+    {
+        m_nodes.for_each([](PathNode& node) { node.generation = 0; });
+        m_generation = 1;
+    }
+
+    m_open_nodes.clear();
+}
+
+
+/// Get a node store for a new search, reusing the memory of a previous search if one is available.
+NodeStore* NodeStore::acquire()
+{
+    NodeStore* node_store = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(m_free_stores_mutex);
+
+        if(!m_free_stores.empty())
+        {
+            node_store = m_free_stores.back();
+            m_free_stores.pop_back();
+        }
+    }
+
+    if(node_store == nullptr)
+    {
+        node_store = new NodeStore();
+    }
+
+    node_store->new_search();
+    return node_store;
+}
+
+
+/// Return a node store that is no longer needed so that a later search can reuse it.
+void NodeStore::release(NodeStore* node_store)
+{
+    std::lock_guard<std::mutex> lock(m_free_stores_mutex);
+    m_free_stores.push_back(node_store);
+}
+
+
+/// Free the stores kept for reuse, once no AI is left to search with them. Stores still in use are kept.
+void NodeStore::free_pool()
+{
+    std::lock_guard<std::mutex> lock(m_free_stores_mutex);
+
+    for(NodeStore* node_store : m_free_stores)
+    {
+        delete node_store;
+    }
+
+    std::vector<NodeStore*>().swap(m_free_stores);
+}
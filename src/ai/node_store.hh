@@ -0,0 +1,115 @@
+/// \file
+#ifndef NODE_STORE_HH
+#define NODE_STORE_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "open_node_heap.hh"
+#include "paged_tile_array.hh"
+#include "path_node.hh"
+#include <mutex>
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Storage for path nodes, indexed directly by TileIndex, and the heap of open nodes of one search frontier.
+     *
+     * Nodes are kept in a PagedTileArray, so memory follows the explored area instead of the map size. Each
+     * node is stamped with the generation of the search that wrote it. Starting a new search only increments
+     * the generation, so the store never has to be cleared and can be handed from one search to the next.
+     * The heap keeps its capacity as well, so once the pool has warmed up a search allocates nothing.
+     */
+    class NodeStore
+    {
+    public:
+
+        NodeStore();
+
+        void new_search();
+
+        /// Return the node stored for this tile in the current search, or nullptr if there is none.
+        PathNode* find(const TileIndex tile_index)
+        {
+            PathNode* node = m_nodes.find(tile_index);
+
+            if(node == nullptr || node->generation != m_generation)
+            {
+                return nullptr;
+            }
+
+            return node;
+        }
+
+        /// Return true if a node is stored for this tile in the current search.
+        bool contains(const TileIndex tile_index)
+        {
+            return find(tile_index) != nullptr;
+        }
+
+        /// Store a node, replacing any node already stored for the same tile.
+        /**
+         * Nodes never move once stored, so the returned reference stays valid until the next search.
+         * @param[in] node The node to store.
+         * @return The stored node.
+         */
+        PathNode& insert(const PathNode& node)
+        {
+            PathNode& stored_node = m_nodes[node.tile_index];
+            stored_node = node;
+            stored_node.generation = m_generation;
+            return stored_node;
+        }
+
+        /// Remove the node stored for this tile, if any.
+        void erase(const TileIndex tile_index)
+        {
+            PathNode* node = m_nodes.find(tile_index);
+
+            if(node != nullptr)
+            {
+                node->generation = 0;
+            }
+        }
+
+        /// Call a function on every node stored in the current search, in no particular order.
+        template <typename Function>
+        void for_each(Function function)
+        {
+            const uint8 generation = m_generation;
+
+            m_nodes.for_each([&](PathNode& node)
+            {
+                if(node.generation == generation)
+                {
+                    function(node);
+                }
+            });
+        }
+
+        /// The open nodes of the search, cheapest first.
+        OpenNodeHeap& open_nodes()
+        {
+            return m_open_nodes;
+        }
+
+        static NodeStore* acquire();
+        static void release(NodeStore* node_store);
+        static void free_pool();
+
+    private:
+
+        PagedTileArray<PathNode> m_nodes;
+        uint8 m_generation;
+
+        OpenNodeHeap m_open_nodes;
+
+        static std::vector<NodeStore*> m_free_stores; ///< Stores released by finished searches, ready for reuse.
+        static std::mutex m_free_stores_mutex;        ///< Searches can run on worker threads, see AsyncPath.
+    };
+}
+
+
+#endif // NODE_STORE_HH
@@ -0,0 +1,224 @@
+/// \file
+#ifndef OPEN_NODE_HEAP_HH
+#define OPEN_NODE_HEAP_HH
+
+
+#include "path_node.hh"
+#include <algorithm>
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Indexed 4-ary min-heap of open path nodes.
+     *
+     * Every node records its own position in the heap, so a node whose cost drops can be moved up in place
+     * instead of being pushed a second time. Each tile is therefore in the heap at most once. A 4-ary heap
+     * is used because it is shallower than a binary heap and the pointers to a node's children share a cache line.
+     *
+     * Nodes are ordered by g + weight * h. The weight is 1 unless a weighted search inflates the heuristic.
+     */
+    class OpenNodeHeap
+    {
+    public:
+
+        bool empty() const
+        {
+            return m_nodes.empty();
+        }
+
+        size_t size() const
+        {
+            return m_nodes.size();
+        }
+
+        /// Add a node that is not yet in the heap.
+        void push(PathNode* node)
+        {
+            node->heap_index = m_nodes.size();
+            m_nodes.push_back(node);
+            sift_up(node->heap_index);
+        }
+
+        /// Restore the heap order after the cost of a node already in the heap was lowered.
+        void decrease_key(PathNode* node)
+        {
+            sift_up(node->heap_index);
+        }
+
+        /// Return the cheapest node without removing it. The heap must not be empty.
+        PathNode* top() const
+        {
+            return m_nodes.front();
+        }
+
+        /// Remove and return the cheapest node. The heap must not be empty.
+        PathNode* pop()
+        {
+            PathNode* cheapest_node = m_nodes.front();
+            remove_at(0);
+            return cheapest_node;
+        }
+
+        /// Forget every node, keeping the memory for the next search. The nodes themselves are left as they are.
+        void clear()
+        {
+            m_nodes.clear();
+            m_weight = WEIGHT_UNIT;
+        }
+
+        /// Weight of the heuristic, in units of 1 / WEIGHT_UNIT.
+        uint32 weight() const
+        {
+            return m_weight;
+        }
+
+        /// Change the weight of the heuristic, and reorder the nodes already in the heap by it.
+        void set_weight(const uint32 weight)
+        {
+            m_weight = weight;
+
+            if(m_nodes.size() < 2)
+            {
+                return;
+            }
+
+            // Sift down every node that has children, starting with the last of them
+            for(uint32 index = (m_nodes.size() - 2) / ARITY + 1; index-- > 0;)
+            {
+                sift_down(index);
+            }
+        }
+
+        /// Return the lowest f cost, without weight, of any node in the heap. The heap must not be empty.
+        int32 min_f() const
+        {
+            int32 min_f = INT32_MAX;
+
+            for(const PathNode* node : m_nodes)
+            {
+                min_f = std::min(min_f, node->f());
+            }
+
+            return min_f;
+        }
+
+        /// Remove a node from anywhere in the heap.
+        void remove(PathNode* node)
+        {
+            remove_at(node->heap_index);
+        }
+
+        /// Weight of a heuristic that isn't inflated
+        static const uint32 WEIGHT_UNIT = 16;
+
+        /// Return true if the first node comes out of the heap before the second.
+        bool cheaper(const PathNode& node, const PathNode& other_node) const
+        {
+            const int64 key = (int64)node.g * WEIGHT_UNIT + (int64)node.h * m_weight;
+            const int64 other_key = (int64)other_node.g * WEIGHT_UNIT + (int64)other_node.h * m_weight;
+
+            // If the cost is the same, the node closer to the end goes first
+            if(key == other_key)
+            {
+                return node.h < other_node.h;
+            }
+
+            return key < other_key;
+        }
+
+    private:
+
+        static const uint32 ARITY = 4;
+
+        void remove_at(const uint32 index)
+        {
+            PathNode* removed_node = m_nodes[index];
+            removed_node->heap_index = PathNode::NOT_IN_HEAP;
+
+            PathNode* last_node = m_nodes.back();
+            m_nodes.pop_back();
+
+            if(last_node == removed_node)
+            {
+                return;
+            }
+
+            // Move the last node into the hole and let it settle in whichever direction it needs to go
+            m_nodes[index] = last_node;
+            last_node->heap_index = index;
+            sift_up(index);
+            sift_down(last_node->heap_index);
+        }
+
+        void sift_up(uint32 index)
+        {
+            PathNode* node = m_nodes[index];
+
+            while(index > 0)
+            {
+                uint32 parent_index = (index - 1) / ARITY;
+                PathNode* parent_node = m_nodes[parent_index];
+
+                if(!cheaper(*node, *parent_node))
+                {
+                    break;
+                }
+
+                m_nodes[index] = parent_node;
+                parent_node->heap_index = index;
+                index = parent_index;
+            }
+
+            m_nodes[index] = node;
+            node->heap_index = index;
+        }
+
+        void sift_down(uint32 index)
+        {
+            PathNode* node = m_nodes[index];
+            const uint32 node_count = m_nodes.size();
+
+            while(true)
+            {
+                uint32 first_child_index = index * ARITY + 1;
+
+                if(first_child_index >= node_count)
+                {
+                    break;
+                }
+
+                // Find the cheapest child
+                uint32 last_child_index = std::min(first_child_index + ARITY, node_count);
+                uint32 cheapest_child_index = first_child_index;
+
+                for(uint32 child_index = first_child_index + 1; child_index < last_child_index; child_index++)
+                {
+                    if(cheaper(*m_nodes[child_index], *m_nodes[cheapest_child_index]))
+                    {
+                        cheapest_child_index = child_index;
+                    }
+                }
+
+                if(!cheaper(*m_nodes[cheapest_child_index], *node))
+                {
+                    break;
+                }
+
+                m_nodes[index] = m_nodes[cheapest_child_index];
+                m_nodes[index]->heap_index = index;
+                index = cheapest_child_index;
+            }
+
+            m_nodes[index] = node;
+            node->heap_index = index;
+        }
+
+        std::vector<PathNode*> m_nodes;
+        uint32 m_weight = WEIGHT_UNIT;
+    };
+}
+
+
+#endif // OPEN_NODE_HEAP_HH
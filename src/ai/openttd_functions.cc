@@ -1,17 +1,24 @@
 /// \file
 
 #include "openttd_functions.hh"
-
-#include <iostream>
+#include "logger.hh"
+#include "map_change_listener.hh"
+#include "metrics.hh"
 
 #include "stdafx.h"
 #include "command_func.h"
+#include "house.h"
+#include "road_map.h"
+#include "town.h"
+#include "town_map.h"
 #include "townname_func.h"
+#include "../../../../script/squirrel_helper_type.hpp"
 
+#include "script_company.hpp"
 #include "script_station.hpp"
 #include "script_road.hpp"
-#include "script_testmode.hpp"
 #include "script_map.hpp"
+#include "script_tile.hpp"
 
 
 void EmpireAI::rename_company(std::string name)
@@ -26,6 +33,13 @@ void EmpireAI::get_money(uint32_t amount)
 }
 
 
+Money EmpireAI::get_bank_balance()
+{
+    Metrics::count(Metrics::SCRIPT_API_CALLS);
+    return ScriptCompany::GetBankBalance(ScriptCompany::COMPANY_SELF);
+}
+
+
 void EmpireAI::print_town_name(Town* town)
 {
     if(town == nullptr)
@@ -37,18 +51,26 @@ void EmpireAI::print_town_name(Town* town)
     char *end = GetTownName(buf, town, lastof(buf));
     (void)end;
 
-    std::cout << "\n" << buf << std::flush;
+    Logger::info(buf);
 }
 
 
-bool EmpireAI::build_road(TileIndex start, TileIndex end)
+/// Issue the command to build a road, without telling anyone about the changed tiles.
+/**
+ * Used directly in test mode, where nothing on the map changes. See ConstructionPlan.
+ */
+bool EmpireAI::issue_build_road(TileIndex start, TileIndex end)
 {
+    Metrics::count(Metrics::SCRIPT_API_CALLS, 2);
+    Metrics::count(Metrics::COMMANDS_ISSUED);
+
     ScriptRoad::SetCurrentRoadType(ScriptRoad::ROADTYPE_ROAD);
 
     try
     {
         if(!ScriptRoad::BuildRoad(start, end))
         {
+            Metrics::count(Metrics::COMMANDS_FAILED);
             return false;
         }
     }
@@ -60,13 +82,18 @@ bool EmpireAI::build_road(TileIndex start, TileIndex end)
 }
 
 
-bool EmpireAI::build_bus_station(TileIndex tile, TileIndex front)
+/// Issue the command to build a bus station, without telling anyone about the changed tile.
+bool EmpireAI::issue_build_bus_station(TileIndex tile, TileIndex front)
 {
+    Metrics::count(Metrics::SCRIPT_API_CALLS);
+    Metrics::count(Metrics::COMMANDS_ISSUED);
+
 	// Build a station on the first available adjacent tile
     try
     {
         if(!ScriptRoad::BuildRoadStation(tile, front, ScriptRoad::ROADVEHTYPE_BUS, ScriptStation::STATION_NEW))
         {
+            Metrics::count(Metrics::COMMANDS_FAILED);
         	return false;
         }
     }
@@ -78,12 +105,17 @@ bool EmpireAI::build_bus_station(TileIndex tile, TileIndex front)
 }
 
 
-bool EmpireAI::build_road_depot(TileIndex tile, TileIndex front)
+/// Issue the command to build a road depot, without telling anyone about the changed tile.
+bool EmpireAI::issue_build_road_depot(TileIndex tile, TileIndex front)
 {
+	Metrics::count(Metrics::SCRIPT_API_CALLS);
+	Metrics::count(Metrics::COMMANDS_ISSUED);
+
 	try
 	{
 		if(!ScriptRoad::BuildRoadDepot(tile, front))
 		{
+			Metrics::count(Metrics::COMMANDS_FAILED);
 			return false;
 		}
 	}
@@ -95,32 +127,159 @@ bool EmpireAI::build_road_depot(TileIndex tile, TileIndex front)
 }
 
 
-bool EmpireAI::can_build_road_building(TileIndex tile, TileIndex direction_offset)
+bool EmpireAI::build_road(TileIndex start, TileIndex end)
 {
-	ScriptTestMode test_mode;
-	return build_bus_station(tile, direction_offset);
+    Metrics::count(Metrics::BUILD_COMMANDS);
+
+    if(!issue_build_road(start, end))
+    {
+        Metrics::count(Metrics::BUILD_COMMANDS_FAILED);
+        return false;
+    }
+
+    MapChangeListener::notify_tiles_changed(start, end);
+    return true;
 }
 
 
-bool EmpireAI::can_build_road(TileIndex start, TileIndex end)
+bool EmpireAI::build_bus_station(TileIndex tile, TileIndex front)
 {
-    ScriptTestMode test_mode;
-    return build_road(start, end);
+    Metrics::count(Metrics::BUILD_COMMANDS);
+
+    if(!issue_build_bus_station(tile, front))
+    {
+        Metrics::count(Metrics::BUILD_COMMANDS_FAILED);
+        return false;
+    }
+
+    MapChangeListener::notify_tile_changed(tile);
+    return true;
 }
 
 
-bool EmpireAI::tile_provides_passengers(TileIndex tile)
+bool EmpireAI::build_road_depot(TileIndex tile, TileIndex front)
 {
-	if(ScriptTile::GetCargoProduction(tile, CT_PASSENGERS, 1, 1, 3) == 0)
+	Metrics::count(Metrics::BUILD_COMMANDS);
+
+	if(!issue_build_road_depot(tile, front))
 	{
+		Metrics::count(Metrics::BUILD_COMMANDS_FAILED);
 		return false;
 	}
 
+	MapChangeListener::notify_tile_changed(tile);
 	return true;
 }
 
 
+/// Determine whether a road can be built on a tile, connecting the two tiles on either side of it.
+/**
+ * @param[in] tile The tile to be examined.
+ * @param[in] from The tile the road arrives from.
+ * @param[in] to The tile the road continues to.
+ * @return
+ */
+bool EmpireAI::can_build_road_through(TileIndex tile, TileIndex from, TileIndex to)
+{
+	Metrics::count(Metrics::SCRIPT_API_CALLS);
+
+	if(ScriptRoad::CanBuildConnectedRoadPartsHere(tile, from, to) <= 0)
+	{
+		return false;
+	}
+
+	return tile_supports_road(tile);
+}
+
+
+/// Determine whether a tile either has a road on it already, or is free to build one.
+bool EmpireAI::tile_supports_road(TileIndex tile)
+{
+	Metrics::count(Metrics::SCRIPT_API_CALLS, 2);
+	return ScriptTile::IsBuildable(tile) || ScriptRoad::IsRoadTile(tile);
+}
+
+
+/// Determine whether a tile is free to build on.
+bool EmpireAI::tile_is_buildable(TileIndex tile)
+{
+    Metrics::count(Metrics::SCRIPT_API_CALLS);
+    return ScriptTile::IsBuildable(tile);
+}
+
+
+uint8 EmpireAI::get_tile_slope(TileIndex tile)
+{
+    Metrics::count(Metrics::SCRIPT_API_CALLS);
+    return ScriptTile::GetSlope(tile);
+}
+
+
+/// Get the road pieces on a tile, the same way ScriptRoad::CanBuildConnectedRoadPartsHere() sees them.
+uint8 EmpireAI::get_road_bits(TileIndex tile)
+{
+    Metrics::count(Metrics::SCRIPT_API_CALLS);
+
+    if(::IsNormalRoadTile(tile))
+    {
+        return ::GetAllRoadBits(tile);
+    }
+
+    return ::GetAnyRoadBits(tile, RTT_ROAD) | ::GetAnyRoadBits(tile, RTT_TRAM);
+}
+
+
+/// Determine whether a road can connect two sides of a tile, given the tile's slope and the road already on it.
+/**
+ * Unlike can_build_road_through(), this only works on the values passed in and never reads the map, so it is
+ * safe to call from a worker thread.
+ * @param[in] slope The slope of the tile, as returned by get_tile_slope().
+ * @param[in] road_bits The road pieces on the tile, as returned by get_road_bits().
+ * @param[in] from_offset Offset from the tile to the tile the road arrives from.
+ * @param[in] to_offset Offset from the tile to the tile the road continues to.
+ * @return
+ */
+bool EmpireAI::can_build_connected_road_parts(uint8 slope, uint8 road_bits, int32 from_offset, int32 to_offset)
+{
+    Metrics::count(Metrics::SCRIPT_API_CALLS);
+
+    // Offsets of the tiles at the ends of ROAD_NW, ROAD_SW, ROAD_SE and ROAD_NE
+    const int32 neighbours[] = {::TileDiffXY(0, -1), ::TileDiffXY(1, 0), ::TileDiffXY(0, 1), ::TileDiffXY(-1, 0)};
+
+    Array* existing = (Array*)alloca(sizeof(Array) + lengthof(neighbours) * sizeof(int32));
+    existing->size = 0;
+
+    for(uint8 i = 0; i < lengthof(neighbours); i++)
+    {
+        if(HasBit(road_bits, i))
+        {
+            existing->array[existing->size++] = neighbours[i];
+        }
+    }
+
+    return ScriptRoad::CanBuildConnectedRoadParts((ScriptTile::Slope)slope, existing, from_offset, to_offset) > 0;
+}
+
+
+/// Get the population of the house on a tile, which passenger generation is proportional to.
+/**
+ * @return The population, or 0 if the tile has no finished house on it.
+ */
+uint8 EmpireAI::get_house_population(TileIndex tile)
+{
+    Metrics::count(Metrics::SCRIPT_API_CALLS);
+
+    if(!::IsTileType(tile, MP_HOUSE) || !::IsHouseCompleted(tile))
+    {
+        return 0;
+    }
+
+    return HouseSpec::Get(::GetHouseType(tile))->population;
+}
+
+
 TileIndex EmpireAI::get_tile_index(uint32_t x, uint32_t y)
 {
+    Metrics::count(Metrics::SCRIPT_API_CALLS);
     return ScriptMap::GetTileIndex(x, y);
 }
@@ -9,23 +9,37 @@
 #include <string>
 
 #include "stdafx.h"
-#include "town.h"
+#include "economy_type.h"
+#include "tile_type.h"
+
+struct Town;
 
 
 namespace EmpireAI
 {
     void rename_company(std::string name);
     void get_money(uint32_t amount);
+    Money get_bank_balance();
     void print_town_name(Town* town);
 
     bool build_bus_station(TileIndex tile, TileIndex front);
     bool build_road_depot(TileIndex tile, TileIndex front);
     bool build_road(TileIndex start, TileIndex end);
 
-    bool can_build_road_building(TileIndex tile, TileIndex direction_offset);
-    bool can_build_road(TileIndex tile, TileIndex direction_offset);
+    // Same as the build functions above, but nothing is told about the changed tiles. Only for use in test mode.
+    bool issue_build_bus_station(TileIndex tile, TileIndex front);
+    bool issue_build_road_depot(TileIndex tile, TileIndex front);
+    bool issue_build_road(TileIndex start, TileIndex end);
+
+    bool can_build_road_through(TileIndex tile, TileIndex from, TileIndex to);
+    bool tile_supports_road(TileIndex tile);
+    bool tile_is_buildable(TileIndex tile);
+
+    uint8 get_tile_slope(TileIndex tile);
+    uint8 get_road_bits(TileIndex tile);
+    bool can_build_connected_road_parts(uint8 slope, uint8 road_bits, int32 from_offset, int32 to_offset);
 
-    bool tile_provides_passengers(TileIndex tile);
+    uint8 get_house_population(TileIndex tile);
 
     TileIndex get_tile_index(uint32_t x, uint32_t y);
 }
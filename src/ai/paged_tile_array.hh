@@ -0,0 +1,144 @@
+/// \file
+#ifndef PAGED_TILE_ARRAY_HH
+#define PAGED_TILE_ARRAY_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "map_func.h"
+#include <memory>
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Array with one element per map tile, indexed directly by TileIndex.
+     *
+     * The map is split into square pages which are only allocated once an element on them is written, so
+     * memory follows the area that has actually been used instead of the map size.
+     */
+    template <typename T>
+    class PagedTileArray
+    {
+    public:
+
+        PagedTileArray()
+        : m_map_log_x(0), m_map_mask_x(0), m_pages_per_row(0)
+        {}
+
+        /// Size the array for the current map. If the map size has changed, every element is discarded.
+        /**
+         * @return True if the array was resized.
+         */
+        bool fit_to_map()
+        {
+            if(m_map_log_x == MapLogX() && m_pages.size() == (MapSize() >> (PAGE_BITS * 2)))
+            {
+                return false;
+            }
+
+            m_map_log_x = MapLogX();
+            m_map_mask_x = MapSizeX() - 1;
+            m_pages_per_row = MapSizeX() >> PAGE_BITS;
+
+            m_pages.clear();
+            m_pages.resize(MapSize() >> (PAGE_BITS * 2));
+            return true;
+        }
+
+        /// Return the element for this tile, or nullptr if nothing on its page has been written yet.
+        T* find(const TileIndex tile_index)
+        {
+            uint32 page_index;
+            uint32 element_index;
+            locate(tile_index, page_index, element_index);
+
+            Page* page = m_pages[page_index].get();
+
+            return page == nullptr ? nullptr : &(*page)[element_index];
+        }
+
+        /// Return the element for this tile, or nullptr if nothing on its page has been written yet.
+        const T* find(const TileIndex tile_index) const
+        {
+            uint32 page_index;
+            uint32 element_index;
+            locate(tile_index, page_index, element_index);
+
+            const Page* page = m_pages[page_index].get();
+
+            return page == nullptr ? nullptr : &(*page)[element_index];
+        }
+
+        /// Return the element for this tile, allocating its page if needed. New elements are value-initialised.
+        T& operator[](const TileIndex tile_index)
+        {
+            uint32 page_index;
+            uint32 element_index;
+            locate(tile_index, page_index, element_index);
+
+            std::unique_ptr<Page>& page = m_pages[page_index];
+
+            if(page == nullptr)
+            {
+                page.reset(new Page(PAGE_SIZE * PAGE_SIZE));
+            }
+
+            return (*page)[element_index];
+        }
+
+        /// Free every page.
+        void clear()
+        {
+            for(std::unique_ptr<Page>& page : m_pages)
+            {
+                page.reset();
+            }
+        }
+
+        /// Call a function on every element of every allocated page.
+        template <typename Function>
+        void for_each(Function function)
+        {
+            for(std::unique_ptr<Page>& page : m_pages)
+            {
+                if(page != nullptr)
+                {
+                    for(T& element : *page)
+                    {
+                        function(element);
+                    }
+                }
+            }
+        }
+
+    private:
+
+        /// Pages are PAGE_SIZE x PAGE_SIZE tiles. Every OpenTTD map dimension is a multiple of this.
+        static const uint32 PAGE_BITS = 5;
+        static const uint32 PAGE_SIZE = 1 << PAGE_BITS;
+        static const uint32 PAGE_MASK = PAGE_SIZE - 1;
+
+        typedef std::vector<T> Page;
+
+        /// Get the page number and the element within that page for a tile.
+        void locate(const TileIndex tile_index, uint32& page_index, uint32& element_index) const
+        {
+            uint32 x = tile_index & m_map_mask_x;
+            uint32 y = tile_index >> m_map_log_x;
+
+            page_index = (y >> PAGE_BITS) * m_pages_per_row + (x >> PAGE_BITS);
+            element_index = ((y & PAGE_MASK) << PAGE_BITS) | (x & PAGE_MASK);
+        }
+
+        std::vector<std::unique_ptr<Page>> m_pages;
+
+        uint32 m_map_log_x;
+        uint32 m_map_mask_x;
+        uint32 m_pages_per_row;
+    };
+}
+
+
+#endif // PAGED_TILE_ARRAY_HH
@@ -0,0 +1,153 @@
+/// \file
+#include "passenger_map.hh"
+#include "openttd_functions.hh"
+
+#include "map_func.h"
+
+#include <algorithm>
+
+using namespace EmpireAI;
+
+
+PassengerMap* PassengerMap::m_instance = nullptr;
+
+
+PassengerMap::PassengerMap()
+: m_next_tile(0), m_row_sum(0), m_map_size_x(0), m_map_size_y(0)
+{
+}
+
+
+PassengerMap* PassengerMap::instance()
+{
+    if(m_instance == nullptr)
+    {
+        m_instance = new PassengerMap();
+    }
+
+    m_instance->reset_if_map_changed();
+    return m_instance;
+}
+
+
+/// Free the table once no AI needs it any more. The next call to instance() starts an empty one.
+void PassengerMap::destroy()
+{
+    delete m_instance;
+    m_instance = nullptr;
+}
+
+
+/// Rescan part of the map, so that houses built or demolished since the last scan are taken into account.
+/**
+ * Must be called on the game thread. A full pass over the map takes MapSize() / max_tile_count calls.
+ * @param[in] max_tile_count The maximum amount of tiles to scan before returning.
+ */
+void PassengerMap::refresh(const uint32 max_tile_count)
+{
+    scan(max_tile_count);
+}
+
+
+/// Get the passenger production of the tiles around a tile.
+/**
+ * Covers the same area as ScriptTile::GetCargoProduction() does for a single tile, but adds up the production of
+ * the houses instead of counting them. Before the first pass over the map is complete, the houses of the area are
+ * read from the map instead.
+ * @param[in] tile The tile in the middle of the area.
+ * @param[in] radius The distance from the middle to the edges of the area.
+ * @return The total population of the houses in the area, as of the last complete scan if there has been one.
+ */
+uint32 PassengerMap::production(const TileIndex tile, const uint32 radius) const
+{
+    const uint32 stride = m_map_size_x + 1;
+
+    // Corners of the area, clamped to the map, as positions in the table
+    const uint32 x0 = TileX(tile) - std::min(TileX(tile), radius);
+    const uint32 y0 = TileY(tile) - std::min(TileY(tile), radius);
+    const uint32 x1 = std::min(TileX(tile) + radius + 1, m_map_size_x);
+    const uint32 y1 = std::min(TileY(tile) + radius + 1, m_map_size_y);
+
+    if(!ready())
+    {
+        uint32 production = 0;
+
+        for(uint32 y = y0; y < y1; y++)
+        {
+            for(uint32 x = x0; x < x1; x++)
+            {
+                production += get_house_population(TileXY(x, y));
+            }
+        }
+
+        return production;
+    }
+
+    // Sums may wrap around on huge maps, but the difference of the four corners is still correct
+    return m_sums[y1 * stride + x1] - m_sums[y0 * stride + x1] - m_sums[y1 * stride + x0] + m_sums[y0 * stride + x0];
+}
+
+
+/// Discard the table and start scanning the map again if a game with a different map size has been started.
+void PassengerMap::reset_if_map_changed()
+{
+    if(m_map_size_x == MapSizeX() && m_map_size_y == MapSizeY())
+    {
+        return;
+    }
+
+    m_map_size_x = MapSizeX();
+    m_map_size_y = MapSizeY();
+
+    // The first row and column are never written, and stay zero in both tables. The table for queries is only
+    // allocated once the first pass is complete.
+    m_sums.clear();
+    m_sums.shrink_to_fit();
+    m_next_sums.assign((size_t)(m_map_size_x + 1) * (m_map_size_y + 1), 0);
+
+    m_next_tile = 0;
+    m_row_sum = 0;
+}
+
+
+/// Scan more tiles into the table being built, and swap it in once the whole map has been scanned.
+/**
+ * @param[in] max_tile_count The maximum amount of tiles to scan before returning.
+ * @return True if a pass over the map was completed.
+ */
+bool PassengerMap::scan(const uint32 max_tile_count)
+{
+    const uint32 stride = m_map_size_x + 1;
+
+    for(uint32 tile_count = 0; tile_count < max_tile_count; tile_count++)
+    {
+        const uint32 x = TileX(m_next_tile);
+        const uint32 y = TileY(m_next_tile);
+
+        if(x == 0)
+        {
+            m_row_sum = 0;
+        }
+
+        m_row_sum += get_house_population(m_next_tile);
+        m_next_sums[(y + 1) * stride + x + 1] = m_next_sums[y * stride + x + 1] + m_row_sum;
+
+        m_next_tile++;
+
+        if(m_next_tile == MapSize())
+        {
+            m_sums.swap(m_next_sums);
+            m_next_tile = 0;
+
+            // After the first pass, the next table has to be allocated
+            if(m_next_sums.empty())
+            {
+                m_next_sums.assign(m_sums.size(), 0);
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,67 @@
+/// \file
+#ifndef PASSENGER_MAP_HH
+#define PASSENGER_MAP_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Map-wide passenger production, stored as a summed-area table so that the production of any rectangle of
+     * tiles can be found with four lookups.
+     *
+     * The production of a tile is the population of the house on it, which is what passenger generation is
+     * proportional to. Towns grow without telling anyone, so the table is rebuilt in the background a few rows
+     * per tick. The new table is built next to the old one and swapped in once complete, so queries always see
+     * a consistent map. The table is dense, at two 32-bit sums per tile once the first pass is complete.
+     *
+     * The first pass over a new map is spread over ticks like every other, rather than stalling the game. Until it
+     * is complete, queries add up the houses around the tile one by one, and only one table is allocated.
+     */
+    class PassengerMap
+    {
+    public:
+
+        /// Catchment radius of a bus station, the area it collects passengers from.
+        static const uint32 BUS_STATION_RADIUS = 3;
+
+        static PassengerMap* instance();
+        static void destroy();
+
+        void refresh(const uint32 max_tile_count);
+
+        uint32 production(const TileIndex tile, const uint32 radius) const;
+
+        /// True once a whole pass over the map has been scanned, and queries use the table.
+        bool ready() const
+        {
+            return !m_sums.empty();
+        }
+
+    private:
+
+        PassengerMap();
+
+        void reset_if_map_changed();
+        bool scan(const uint32 max_tile_count);
+
+        static PassengerMap* m_instance;
+
+        std::vector<uint32> m_sums;      ///< The summed-area table used for queries, with a row and column of zeroes first.
+                                         ///< Empty until the first pass is complete.
+        std::vector<uint32> m_next_sums; ///< The summed-area table being built.
+
+        TileIndex m_next_tile; ///< The next tile to scan into m_next_sums.
+        uint32 m_row_sum;      ///< Production of the row being scanned, up to m_next_tile.
+
+        uint32 m_map_size_x;
+        uint32 m_map_size_y;
+    };
+}
+
+
+#endif // PASSENGER_MAP_HH
@@ -1,11 +1,9 @@
 /// \file
 #include "path.hh"
-
-#include "script_map.hpp"
-#include "script_road.hpp"
-#include "script_tile.hpp"
+#include "metrics.hh"
 
 #include <algorithm>
+#include <unordered_set>
 
 using namespace EmpireAI;
 
@@ -13,19 +11,52 @@ using namespace EmpireAI;
 /**
  * @param[in] start The tile at the start of the path to find.
  * @param[in] end The The tile at the end of the path to find.
+ * @param[in] search_mode Whether to search from the start tile only, or from both tiles at once.
+ * @param[in] map_access The policy to read the map through.
  */
-Path::Path(const TileIndex start, const TileIndex end)
-: m_start_tile_index(start), m_end_tile_index(end)
+template<class MapAccess>
+BasicPath<MapAccess>::BasicPath(const TileIndex start, const TileIndex end, const SearchMode search_mode,
+	const MapAccess& map_access)
+: m_map_access(map_access), m_search_mode(search_mode), m_start_tile_index(start), m_end_tile_index(end)
 {
-	// Create an open node at the start
-	Node start_node = get_node(start);
-	start_node.f = start_node.h;
-	open_node(start_node);
+	m_expanded_node_count = 0;
+	m_meeting_cost = NOT_MET;
+	m_meeting_tile_index = INVALID_TILE;
+	m_meeting_forward_tile_index = INVALID_TILE;
+	m_meeting_backward_tile_index = INVALID_TILE;
+	m_suboptimality_bound = 1.0;
+
+	// There is nothing for two frontiers to meet in between, or to improve on, if start and end are the same tile
+	if(start == end)
+	{
+		m_search_mode = FORWARD;
+	}
+
+	start_frontier(m_forward_frontier, start, end);
+
+	if(m_search_mode == ANYTIME)
+	{
+		m_forward_frontier.open_nodes().set_weight(ANYTIME_INITIAL_WEIGHT);
+	}
+
+	if(m_search_mode == BIDIRECTIONAL)
+	{
+		start_frontier(m_backward_frontier, end, start);
+	}
 
 	m_status = IN_PROGRESS;
 }
 
 
+/// Return the node storage to the pool so that the next search can reuse it.
+template<class MapAccess>
+BasicPath<MapAccess>::~BasicPath()
+{
+	release_frontier(m_forward_frontier);
+	release_frontier(m_backward_frontier);
+}
+
+
 /// Find a partial path from start to end, returning true if the full path has been found.
 /**
  * This function must be called repeatedly until either a path is found or the pathfinder
@@ -33,74 +64,466 @@ Path::Path(const TileIndex start, const TileIndex end)
  * @param[in] max_node_count The maximum amount of nodes to search before returning.
  * @return The status of the pathfinder.
  */
-Path::Status Path::find(const uint16_t max_node_count)
+template<class MapAccess>
+typename BasicPath<MapAccess>::Status BasicPath<MapAccess>::find(const uint16_t max_node_count)
 {
     if(m_status != IN_PROGRESS)
     {
         return m_status;
     }
 
+	const uint32 expanded_node_count = m_expanded_node_count;
+
 	// While not at end of path
 	for(uint16 node_count = 0; node_count < max_node_count; node_count++)
 	{
+		// Once neither frontier can improve on the path through the meeting tile, it is the shortest path
+		if(m_search_mode == BIDIRECTIONAL && frontiers_have_met())
+		{
+			m_status = FOUND;
+			break;
+		}
+
+		// Each path of an ANYTIME search is complete once no open node can lead to a cheaper one
+		if(m_search_mode == ANYTIME && end_reached_at_least_cost())
+		{
+			finish_iteration();
+
+			if(m_status != IN_PROGRESS)
+			{
+				break;
+			}
+
+			continue;
+		}
+
 		// Get the cheapest open node
-		bool open_node_available = false;
-		Node current_node = cheapest_open_node(open_node_available);
+		Frontier& frontier = next_frontier();
+		Node* current_node = cheapest_open_node(frontier);
 
-		// If there are no open nodes, the path is unreachable
-		if(!open_node_available)
+		// If there are no open nodes, the path is unreachable unless the two frontiers have already met
+		if(current_node == nullptr)
 		{
-			m_status = UNREACHABLE;
+			m_status = m_meeting_cost == NOT_MET ? UNREACHABLE : FOUND;
 			break;
 		}
 
         // Mark the current node as closed
-	    close_node(current_node);
+	    close_node(*current_node);
+	    m_expanded_node_count++;
 
 	    // If we've reached the destination, return true
-	    if(current_node.tile_index == m_end_tile_index)
+	    if(m_search_mode == FORWARD && current_node->tile_index == m_end_tile_index)
 	    {
 	    	m_status = FOUND;
 	        break;
 	    }
 
         // Calculate the f, h, g, values of the 4 surrounding nodes
-	    parse_adjacent_tile(current_node, 1, 0);
-	    parse_adjacent_tile(current_node, -1, 0);
-	    parse_adjacent_tile(current_node, 0, 1);
-	    parse_adjacent_tile(current_node, 0, -1);
+	    parse_adjacent_tile<1, 0>(frontier, *current_node);
+	    parse_adjacent_tile<-1, 0>(frontier, *current_node);
+	    parse_adjacent_tile<0, 1>(frontier, *current_node);
+	    parse_adjacent_tile<0, -1>(frontier, *current_node);
+	}
+
+	Metrics::count(Metrics::NODES_EXPANDED, m_expanded_node_count - expanded_node_count);
+
+	if(m_status != IN_PROGRESS)
+	{
+		finish_search();
 	}
 
 	return m_status;
 }
 
 
+/// Stop an ANYTIME search and keep the path it has found so far.
+/**
+ * find() returns FOUND from then on. Does nothing unless a path has been found and the search is still improving it.
+ */
+template<class MapAccess>
+void BasicPath<MapAccess>::accept_route()
+{
+	if(m_status != IN_PROGRESS || !has_route())
+	{
+		return;
+	}
+
+	m_status = FOUND;
+	finish_search();
+}
+
+
+/// Determine whether an ANYTIME search has found the cheapest path it can with its current weight.
+/**
+ * That is the case once the end tile has been reached and no open node comes before it in the open nodes list.
+ * @return True if the current iteration of the search is complete.
+ */
+template<class MapAccess>
+bool BasicPath<MapAccess>::end_reached_at_least_cost()
+{
+	const Node* end_node = m_forward_frontier.nodes->find(m_end_tile_index);
+
+	if(end_node == nullptr || !end_node->reached())
+	{
+		return false;
+	}
+
+	OpenNodeHeap& open_nodes = m_forward_frontier.open_nodes();
+
+	return open_nodes.empty() || !open_nodes.cheaper(*open_nodes.top(), *end_node);
+}
+
+
+/// Keep the path an ANYTIME search has just found, and lower the weight to look for a shorter one.
+/**
+ * Any path shorter than the one found has to pass through an open or inconsistent node, so the lowest f cost of
+ * those nodes bounds how much shorter it can be. Once the bound reaches 1, or the weight can't be lowered any
+ * further, the path is the shortest and the search is over. Otherwise the inconsistent nodes are opened again and
+ * every expanded node may be expanded again with the new weight, while the costs already found are kept.
+ */
+template<class MapAccess>
+void BasicPath<MapAccess>::finish_iteration()
+{
+	build_route();
+
+	OpenNodeHeap& open_nodes = m_forward_frontier.open_nodes();
+	const int32 end_g = m_forward_frontier.nodes->find(m_end_tile_index)->g;
+	int32 lowest_f = end_g;
+
+	if(!open_nodes.empty())
+	{
+		lowest_f = std::min(lowest_f, open_nodes.min_f());
+	}
+
+	for(const Node* node : m_inconsistent_nodes)
+	{
+		lowest_f = std::min(lowest_f, node->f());
+	}
+
+	const double weight = (double)open_nodes.weight() / OpenNodeHeap::WEIGHT_UNIT;
+	m_suboptimality_bound = std::max(1.0, std::min(weight, (double)end_g / lowest_f));
+
+	if(open_nodes.weight() == OpenNodeHeap::WEIGHT_UNIT || m_suboptimality_bound == 1.0)
+	{
+		m_suboptimality_bound = 1.0;
+		m_status = FOUND;
+		return;
+	}
+
+	for(Node* node : m_closed_nodes)
+	{
+		node->set_closed(false);
+	}
+
+	for(Node* node : m_inconsistent_nodes)
+	{
+		if(node->heap_index == Node::NOT_IN_HEAP)
+		{
+			open_nodes.push(node);
+		}
+	}
+
+	m_closed_nodes.clear();
+	m_inconsistent_nodes.clear();
+
+	const uint32 next_weight = open_nodes.weight() - ANYTIME_WEIGHT_STEP;
+	open_nodes.set_weight(next_weight > OpenNodeHeap::WEIGHT_UNIT ? next_weight : (uint32)OpenNodeHeap::WEIGHT_UNIT);
+}
+
+
+/// Record the result of a search that is over, and hand its nodes to the next search.
+template<class MapAccess>
+void BasicPath<MapAccess>::finish_search()
+{
+	if(m_status == FOUND)
+	{
+		// An ANYTIME search stores each path as soon as it is found
+		if(m_search_mode != ANYTIME)
+		{
+			build_route();
+		}
+
+		Metrics::count(Metrics::PATHS_FOUND);
+		Metrics::record(Metrics::PATH_LENGTH, m_route.size());
+	}
+	else if(m_status == UNREACHABLE)
+	{
+		Metrics::count(Metrics::PATHS_UNREACHABLE);
+	}
+
+	Metrics::record(Metrics::PATH_NODES_EXPANDED, m_expanded_node_count);
+
+	m_closed_nodes.clear();
+	m_inconsistent_nodes.clear();
+
+	release_frontier(m_forward_frontier);
+	release_frontier(m_backward_frontier);
+}
+
+
+/// Confine the search to the clusters of a corridor.
+/**
+ * Must be called before the first call to find(). The start and end tiles must lie inside the corridor.
+ * @param[in] corridor The clusters the search is allowed to enter.
+ */
+template<class MapAccess>
+void BasicPath<MapAccess>::set_corridor(const Corridor& corridor)
+{
+	m_corridor.reset(new Corridor(corridor));
+}
+
+
+/// Guide the search with the ALT heuristic as well as the Manhattan distance.
+/**
+ * Must be called before the first call to find(). The search keeps the tables, even if newer ones are built.
+ * @param[in] landmarks The tables to take the bounds from, or nullptr to use the Manhattan distance only.
+ */
+template<class MapAccess>
+void BasicPath<MapAccess>::set_landmarks(const std::shared_ptr<const LandmarkTables>& landmarks)
+{
+	m_landmarks = landmarks;
+
+	m_forward_frontier.target_landmark_distances = nullptr;
+	m_backward_frontier.target_landmark_distances = nullptr;
+
+	if(m_landmarks == nullptr)
+	{
+		return;
+	}
+
+	m_forward_frontier.target_landmark_distances = m_landmarks->distances(m_end_tile_index);
+
+	if(m_search_mode == BIDIRECTIONAL)
+	{
+		m_backward_frontier.target_landmark_distances = m_landmarks->distances(m_start_tile_index);
+	}
+}
+
+
+/// Start the search from every tile of a known route, as well as from the start tile.
+/**
+ * Must be called before the first call to find(). Each tile of the route is opened with its distance along the
+ * route as its cost, and leads back to the start tile along the route. A search that joins the route therefore
+ * finds the branch from the route to the end tile, and the path it builds follows the route back to the start.
+ * @param[in] route A route that begins at the start tile.
+ */
+template<class MapAccess>
+void BasicPath<MapAccess>::seed_route(const std::vector<TileIndex>& route)
+{
+	if(route.empty() || route.front() != m_start_tile_index || m_start_tile_index == m_end_tile_index)
+	{
+		return;
+	}
+
+	for(size_t index = 1; index < route.size(); index++)
+	{
+		Node& node = get_node(m_forward_frontier, route[index]);
+		const int32 g = (int32)index;
+
+		// Routes that share tiles are joined where they are cheapest
+		if(node.reached() && node.g <= g)
+		{
+			continue;
+		}
+
+		node.g = g;
+		node.set_reached();
+		node.set_previous_tile_index(route[index - 1]);
+		open_node(m_forward_frontier, node);
+	}
+}
+
+
+/// Use a route that is already known instead of searching for one.
+/**
+ * find() returns FOUND from then on.
+ * @param[in] route The route, from the start tile to the end tile.
+ */
+template<class MapAccess>
+void BasicPath<MapAccess>::set_route(const std::vector<TileIndex>& route)
+{
+	m_route.assign(route.rbegin(), route.rend());
+	m_status = FOUND;
+
+	release_frontier(m_forward_frontier);
+	release_frontier(m_backward_frontier);
+}
+
+
+/// Return true if the search is confined to a corridor.
+template<class MapAccess>
+bool BasicPath<MapAccess>::has_corridor() const
+{
+	return m_corridor != nullptr;
+}
+
+
+/// Create a frontier with a single open node at its start tile.
+/**
+ * @param[out] frontier The frontier to start.
+ * @param[in] start The tile the frontier searches from.
+ * @param[in] target The tile the frontier searches towards.
+ */
+template<class MapAccess>
+void BasicPath<MapAccess>::start_frontier(Frontier& frontier, const TileIndex start, const TileIndex target)
+{
+	frontier.nodes = NodeStore::acquire();
+	frontier.node_count = 0;
+	frontier.target_tile_index = target;
+
+	Node& start_node = get_node(frontier, start);
+	start_node.set_reached();
+	open_node(frontier, start_node);
+}
+
+
+/// Return the node storage of a frontier to the pool, if it still holds any.
+/**
+ * @param[in] frontier The frontier that is no longer needed.
+ */
+template<class MapAccess>
+void BasicPath<MapAccess>::release_frontier(Frontier& frontier)
+{
+	if(frontier.nodes != nullptr)
+	{
+		NodeStore::release(frontier.nodes);
+		frontier.nodes = nullptr;
+	}
+}
+
+
+/// Choose the frontier to expand next.
+/**
+ * A bidirectional search expands the frontier with fewer open nodes, which keeps both frontiers to a similar size.
+ * @return The frontier to expand.
+ */
+template<class MapAccess>
+typename BasicPath<MapAccess>::Frontier& BasicPath<MapAccess>::next_frontier()
+{
+	if(m_search_mode == BIDIRECTIONAL &&
+		m_backward_frontier.open_nodes().size() < m_forward_frontier.open_nodes().size())
+	{
+		return m_backward_frontier;
+	}
+
+	return m_forward_frontier;
+}
+
+
+/// Determine whether the path through the best meeting tile found so far is the shortest path.
+/**
+ * Every path that is still undiscovered has to leave each frontier through one of its open nodes. The f cost of an open
+ * node never overestimates the length of a path through it, so once the cheapest open node of either frontier costs
+ * at least as much as the path through the meeting tile, no shorter path can exist.
+ * @return True if the search can stop.
+ */
+template<class MapAccess>
+bool BasicPath<MapAccess>::frontiers_have_met()
+{
+	if(m_meeting_cost == NOT_MET)
+	{
+		return false;
+	}
+
+	return m_forward_frontier.open_nodes().empty() || m_forward_frontier.open_nodes().top()->f() >= m_meeting_cost ||
+		m_backward_frontier.open_nodes().empty() || m_backward_frontier.open_nodes().top()->f() >= m_meeting_cost;
+}
+
+
+/// Check whether a tile next to the current node has also been expanded by the opposite frontier.
+/**
+ * If it has, the two frontiers can be joined on that tile. The path through it is kept if it is shorter than the
+ * best path found so far, and a road can pass through the tile from one frontier to the other. A tile that is
+ * still open in the opposite frontier may yet get a lower cost and another previous tile, which would no longer
+ * match the recorded meeting, so it only counts once the opposite frontier has expanded it. The meeting is then
+ * found from the other side, when the opposite frontier expands the tile and finds the current node next to it.
+ * @param[in] frontier The frontier of the current node.
+ * @param[in] current_node The node being expanded, which can already connect to the meeting tile.
+ * @param[in] meeting_tile_index The tile next to the current node.
+ */
+template<class MapAccess>
+void BasicPath<MapAccess>::check_meeting(const Frontier& frontier, const Node& current_node, const TileIndex meeting_tile_index)
+{
+	const bool forward = &frontier == &m_forward_frontier;
+	const Frontier& opposite_frontier = forward ? m_backward_frontier : m_forward_frontier;
+
+	const Node* opposite_node = opposite_frontier.nodes->find(meeting_tile_index);
+
+	if(opposite_node == nullptr || !opposite_node->closed())
+	{
+		return;
+	}
+
+	int32 cost = current_node.g + 1 + opposite_node->g;
+
+	if(cost >= m_meeting_cost)
+	{
+		return;
+	}
+
+	TileIndex forward_tile_index = forward ? current_node.tile_index : opposite_node->previous_tile_index();
+	TileIndex backward_tile_index = forward ? opposite_node->previous_tile_index() : current_node.tile_index;
+
+	// The meeting tile is checked like any other tile on the path, except for the start and end tiles
+	if(forward_tile_index != INVALID_TILE && backward_tile_index != INVALID_TILE &&
+		!tile_can_connect_road(meeting_tile_index, forward_tile_index, backward_tile_index))
+	{
+		return;
+	}
+
+	m_meeting_cost = cost;
+	m_meeting_tile_index = meeting_tile_index;
+	m_meeting_forward_tile_index = forward_tile_index;
+	m_meeting_backward_tile_index = backward_tile_index;
+}
+
+
 /// Examine a node adjacent to the current node.
 /**
  * If the adjacent node has not yet been examined, or
  * it can be reached more cheaply via this current node than the node is was previously reached through,
- * add it to the list of open nodes to be examined later. Otherwise, add it to the closed node list.
+ * add it to the list of open nodes to be examined later. If a road can't continue from the current node
+ * towards the adjacent node, the adjacent node is left as it is, since it may still be reachable from another direction.
+ * In a bidirectional search, the adjacent node is also checked for a meeting with the opposite frontier.
+ * @param[in] frontier The frontier of the current node.
  * @param[in] current_node The current node.
- * @param[in] x X offset of the adjacent node to be examined.
- * @param[in] y Y offset of the adjacent node to be examined.
+ * @tparam X X offset of the adjacent node to be examined.
+ * @tparam Y Y offset of the adjacent node to be examined.
  */
-void Path::parse_adjacent_tile(const Node& current_node, const int8 x, const int8 y)
+template<class MapAccess>
+template<int8 X, int8 Y>
+void BasicPath<MapAccess>::parse_adjacent_tile(Frontier& frontier, const Node& current_node)
 {
-    TileIndex adjacent_tile_index = current_node.tile_index + ScriptMap::GetTileIndex(x, y);
+    TileIndex adjacent_tile_index = m_map_access.template adjacent_tile<X, Y>(current_node.tile_index);
+
+    // Tiles off the edge of the map can never be part of the path
+    if(!m_map_access.is_valid_tile(adjacent_tile_index))
+    {
+        return;
+    }
 
-    Node adjacent_node = get_node(adjacent_tile_index);
+    if(m_corridor != nullptr && !m_corridor->contains(adjacent_tile_index))
+    {
+        return;
+    }
 
     // Check to see if this tile can be used as part of the path
-    if(nodes_can_connect_road(current_node, adjacent_node))
+    if(!nodes_can_connect_road(current_node, adjacent_tile_index))
+    {
+        return;
+    }
+
+    Node& adjacent_node = get_node(frontier, adjacent_tile_index);
+
+    if(adjacent_node.update_costs(current_node))
     {
-        if(adjacent_node.update_costs(current_node))
-        {
-            open_node(adjacent_node);
-        }
+        open_node(frontier, adjacent_node);
     }
-    else
+
+    if(m_search_mode == BIDIRECTIONAL)
     {
-    	close_node(adjacent_node);
+        check_meeting(frontier, current_node, adjacent_tile_index);
     }
 }
 
@@ -108,134 +531,470 @@ void Path::parse_adjacent_tile(const Node& current_node, const int8 x, const int
 /// Determine whether a road can be built on the first node in the direction of the second node.
 /**
  * @param[in] node_from Node to be examined.
- * @param[in] node_to Node to be connected to the first node.
+ * @param[in] tile_to Tile to be connected to the first node.
  * @return
  */
-bool Path::nodes_can_connect_road(const Node& node_from, const Node& node_to)
+template<class MapAccess>
+bool BasicPath<MapAccess>::nodes_can_connect_road(const Node& node_from, const TileIndex tile_to)
 {
 	// The start node doesn't connect to a previous node, so we can't check it for the correct slope.
 	// The pathfinder can only ensure that the next node in the path can connect to the start node.
-	if(node_from.previous_tile_index == INVALID_TILE)
+	const TileIndex previous_tile_index = node_from.previous_tile_index();
+
+	if(previous_tile_index == INVALID_TILE)
 	{
 		return true;
 	}
 
-	Node node_from_previous = get_node(node_from.previous_tile_index);
+	return tile_can_connect_road(node_from.tile_index, previous_tile_index, tile_to);
+}
 
-	int32 supports_road = ScriptRoad::CanBuildConnectedRoadPartsHere(node_from.tile_index, node_from_previous.tile_index, node_to.tile_index);
 
-	if(supports_road <= 0)
-	{
-		return false;
-	}
+/// Determine whether a road can be built on a tile, connecting the two tiles on either side of it.
+/**
+ * @param[in] tile The tile to be examined.
+ * @param[in] tile_from The tile the road arrives from.
+ * @param[in] tile_to The tile the road continues to.
+ * @return
+ */
+template<class MapAccess>
+bool BasicPath<MapAccess>::tile_can_connect_road(const TileIndex tile, const TileIndex tile_from, const TileIndex tile_to)
+{
+	return m_map_access.can_build_road_through(tile, tile_from, tile_to);
+}
+
 
-	if(!ScriptTile::IsBuildable(node_from.tile_index) && !ScriptRoad::IsRoadTile(node_from.tile_index))
+/// Remove the open node with the cheapest f cost from the open nodes list of a frontier.
+/**
+ * @param[in] frontier The frontier to take the node from.
+ * @return The cheapest open node, or nullptr if there are no open nodes.
+ */
+template<class MapAccess>
+typename BasicPath<MapAccess>::Node* BasicPath<MapAccess>::cheapest_open_node(Frontier& frontier)
+{
+	if(frontier.open_nodes().empty())
 	{
-		return false;
+		return nullptr;
 	}
 
-	return true;
+	return frontier.open_nodes().pop();
 }
 
 
-/// Get the open node with the cheapest f cost.
+/// Return the node corresponding to this tile. If the frontier hasn't reached the tile yet, create a new node.
 /**
- * @param[out] success Set to false if there are no open nodes, otherwise true.
- * @return The cheapest open node.
+ * @param[in] frontier The frontier the node belongs to.
+ * @param[in] tile_index Tile index of the node to be returned.
+ * @return
  */
-Path::Node Path::cheapest_open_node(bool& success)
+template<class MapAccess>
+typename BasicPath<MapAccess>::Node& BasicPath<MapAccess>::get_node(Frontier& frontier, const TileIndex tile_index)
 {
-	success = false;
+    Node* node = frontier.nodes->find(tile_index);
 
-	// While there are open nodes available
-	while(!m_open_nodes.empty())
-	{
-		// Remove the cheapest node from the open nodes list
-		Node current_node = m_open_nodes.top();
-		m_open_nodes.pop();
+    if(node == nullptr)
+    {
+    	uint32 h = m_map_access.distance(tile_index, frontier.target_tile_index);
 
-		// If this node has already been closed, skip to the next one. Duplicates are expected
-		// here because get_node() doesn't check for duplicates for performance reasons.
-		if(m_closed_nodes.find(current_node.tile_index) != m_closed_nodes.end())
-		{
-			continue;
-		}
+    	// Both estimates never exceed the road distance, so the larger one is the better estimate
+    	if(frontier.target_landmark_distances != nullptr)
+    	{
+    		h = std::max(h, m_landmarks->lower_bound(tile_index, frontier.target_landmark_distances));
+    	}
 
-		success = true;
-		return current_node;
+    	frontier.node_count++;
+    	return frontier.nodes->insert(Node(tile_index, h));
+    }
+
+    return *node;
+}
+
+
+/// Place this node into the open nodes list, or move it up the list if it is already open and has become cheaper.
+/**
+ * Each tile is in the open nodes list at most once. A closed node that has become cheaper is reopened.
+ * @param[in] frontier The frontier the node belongs to.
+ * @param[in] node The node to be opened.
+ */
+template<class MapAccess>
+void BasicPath<MapAccess>::open_node(Frontier& frontier, Node& node)
+{
+	// An ANYTIME search expands each node at most once per path, and opens the rest again for the next path
+	if(m_search_mode == ANYTIME && node.closed())
+	{
+		m_inconsistent_nodes.push_back(&node);
+		return;
 	}
 
-	// There are no more open nodes
-	return Node();
+	node.set_closed(false);
+
+	if(node.heap_index == Node::NOT_IN_HEAP)
+	{
+		frontier.open_nodes().push(&node);
+	}
+	else
+	{
+		frontier.open_nodes().decrease_key(&node);
+	}
 }
 
 
-/// Return the closed node corresponding to this tile. If there is no closed node for this tile, create a new node.
+/// Mark this node as closed.
 /**
- * Duplicate open nodes are considered an acceptable tradeoff since it's not easy to search std::priority_queue
- * for an already existing open node.
- * @param[in] tile_index Tile index of the node to be returned.
- * @return
+ * @param[in] node The node to be closed. It must already have been removed from the open nodes list.
  */
-Path::Node Path::get_node(const TileIndex tile_index)
+template<class MapAccess>
+void BasicPath<MapAccess>::close_node(Node& node)
 {
-    // If the node is not closed, create a new one
-    if(m_closed_nodes.find(tile_index) == m_closed_nodes.end())
+    node.set_closed(true);
+
+    if(m_search_mode == ANYTIME)
     {
-    	return Node(tile_index, ScriptMap::DistanceManhattan(tile_index, m_end_tile_index));
+    	m_closed_nodes.push_back(&node);
     }
+}
+
+
+/// Store the found path, from the end tile back to the start tile, so that it can be iterated once the nodes are released.
+template<class MapAccess>
+void BasicPath<MapAccess>::build_route()
+{
+	m_route.clear();
+
+	if(m_search_mode != BIDIRECTIONAL)
+	{
+		append_route(m_forward_frontier, m_end_tile_index);
+		return;
+	}
+
+	// The backward frontier leads from the meeting tile to the end tile, so its part of the path is reversed
+	append_route(m_backward_frontier, m_meeting_backward_tile_index);
+	std::reverse(m_route.begin(), m_route.end());
 
-    return m_closed_nodes.at(tile_index);
+	m_route.push_back(m_meeting_tile_index);
+	append_route(m_forward_frontier, m_meeting_forward_tile_index);
 }
 
 
-/// Place this node into the open nodes list. If the node was previously in the closed nodes list,
-/// remove it from that list.
+/// Append the tiles leading from a tile back to the start of its frontier.
 /**
- * @param[in] node The node to be opened.
+ * A route never passes through more tiles than the frontier has nodes, so a broken chain of previous tiles
+ * can't loop forever.
+ * @param[in] frontier The frontier that reached the tile.
+ * @param[in] tile_index The first tile to append. Nothing is appended if this is INVALID_TILE.
+ */
+template<class MapAccess>
+void BasicPath<MapAccess>::append_route(const Frontier& frontier, TileIndex tile_index)
+{
+	for(uint32 count = 0; tile_index != INVALID_TILE && count < frontier.node_count; count++)
+	{
+		m_route.push_back(tile_index);
+		tile_index = frontier.nodes->find(tile_index)->previous_tile_index();
+	}
+}
+
+
+/// Write the search into a savegame, so that it can carry on where it stopped once the game is loaded.
+/**
+ * Every node the search has reached is written with its cost and its previous tile, but not its heuristic, which
+ * is worked out again on loading. A search that is over only writes its result.
+ * @param[out] writer The writer to append the search to.
  */
-void Path::open_node(const Node& node)
+template<class MapAccess>
+void BasicPath<MapAccess>::save(SaveWriter& writer)
 {
-	// Push the node into the open node list. Does not check open nodes, instead allowing
-	// duplicates to be created in the open node priority queue, since checking for already open nodes is slower
-	// than just processing a node twice.
-	m_open_nodes.push(node);
+	writer.write_uint8((uint8)m_search_mode);
+	writer.write_uint32(m_start_tile_index);
+	writer.write_uint32(m_end_tile_index);
+	writer.write_uint8((uint8)m_status);
+	writer.write_uint32(m_expanded_node_count);
+	writer.write_uint32((uint32)(m_suboptimality_bound * SAVED_BOUND_UNIT));
+	writer.write_tiles(m_route);
+
+	if(m_status != IN_PROGRESS)
+	{
+		return;
+	}
+
+	writer.write_uint8(m_corridor != nullptr);
+
+	if(m_corridor != nullptr)
+	{
+		m_corridor->save(writer);
+	}
+
+	writer.write_uint32((uint32)m_meeting_cost);
+	writer.write_uint32(m_meeting_tile_index);
+	writer.write_uint32(m_meeting_forward_tile_index);
+	writer.write_uint32(m_meeting_backward_tile_index);
+
+	save_frontier(writer, m_forward_frontier);
+
+	if(m_search_mode == BIDIRECTIONAL)
+	{
+		save_frontier(writer, m_backward_frontier);
+	}
+}
+
+
+/// Create a search from the data written by save(), carrying on where the saved search stopped.
+/**
+ * The heuristic is worked out from the landmark tables at hand, which may have been built again since the search
+ * was saved. LandmarkMap::tables() withholds tables that a reported change of the map may have made too high, so any
+ * tables it hands out give a heuristic that never overestimates, and the search still finds the shortest path.
+ * @param[in] reader The reader to read the search from.
+ * @param[in] landmarks The tables to take the bounds from, or nullptr to use the Manhattan distance only.
+ * @param[in] map_access The policy to read the map through.
+ * @return The search, or nullptr if the data was invalid.
+ */
+template<class MapAccess>
+BasicPath<MapAccess>* BasicPath<MapAccess>::load(SaveReader& reader, const std::shared_ptr<const LandmarkTables>& landmarks,
+	const MapAccess& map_access)
+{
+	const uint8 search_mode = reader.read_uint8();
+	const TileIndex start = reader.read_tile();
+	const TileIndex end = reader.read_tile();
+	const uint8 status = reader.read_uint8();
+
+	if(reader.failed() || search_mode > ANYTIME || status > UNREACHABLE)
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<BasicPath> path(new BasicPath(start, end, (SearchMode)search_mode, map_access));
+	path->set_landmarks(landmarks);
+
+	path->m_expanded_node_count = reader.read_uint32();
+	path->m_suboptimality_bound = (double)reader.read_uint32() / SAVED_BOUND_UNIT;
+	reader.read_tiles(path->m_route);
+
+	// Roads are built along the route one tile after another, so a route that jumps between tiles is invalid
+	if((status == FOUND || !path->m_route.empty()) && !path->route_is_valid())
+	{
+		reader.fail();
+	}
+
+	if(status != IN_PROGRESS)
+	{
+		path->m_status = (Status)status;
+		path->release_frontier(path->m_forward_frontier);
+		path->release_frontier(path->m_backward_frontier);
+
+		return reader.failed() ? nullptr : path.release();
+	}
+
+	if(reader.read_uint8() != 0)
+	{
+		Corridor corridor;
+		corridor.load(reader);
+		path->set_corridor(corridor);
+	}
+
+	path->m_meeting_cost = (int32)reader.read_uint32();
+	path->m_meeting_tile_index = reader.read_uint32();
+	path->m_meeting_forward_tile_index = reader.read_uint32();
+	path->m_meeting_backward_tile_index = reader.read_uint32();
+
+	path->load_frontier(reader, path->m_forward_frontier, start);
+
+	if(path->m_search_mode == BIDIRECTIONAL)
+	{
+		path->load_frontier(reader, path->m_backward_frontier, end);
+
+		// Once the frontiers have met, the path is followed back from the meeting tile through both of them
+		if(path->m_meeting_cost != NOT_MET && (path->m_meeting_tile_index >= MapSize() ||
+			!path->leads_to_start(path->m_forward_frontier, path->m_meeting_forward_tile_index) ||
+			!path->leads_to_start(path->m_backward_frontier, path->m_meeting_backward_tile_index)))
+		{
+			reader.fail();
+		}
+	}
 
-	// Remove the node from the closed list
-	m_closed_nodes.erase(node.tile_index);
+	return reader.failed() ? nullptr : path.release();
 }
 
 
-/// Place this node in the closed nodes list.
+/// Write every node a frontier has reached, and which of them are open.
 /**
- * @param[in] node The node to be closed.
+ * @param[out] writer The writer to append the nodes to.
+ * @param[in] frontier The frontier to save.
  */
-void Path::close_node(const Node& node)
+template<class MapAccess>
+void BasicPath<MapAccess>::save_frontier(SaveWriter& writer, Frontier& frontier)
 {
-    m_closed_nodes[node.tile_index] = node;
+	const std::unordered_set<const Node*> inconsistent_nodes(m_inconsistent_nodes.begin(), m_inconsistent_nodes.end());
+
+	writer.write_uint32(frontier.open_nodes().weight());
+	writer.write_uint32(frontier.node_count);
+
+	frontier.nodes->for_each([&](const Node& node)
+	{
+		uint8 saved_flags = 0;
+
+		if(node.heap_index != Node::NOT_IN_HEAP)
+		{
+			saved_flags |= SAVED_OPEN;
+		}
+
+		if(inconsistent_nodes.count(&node) != 0)
+		{
+			saved_flags |= SAVED_INCONSISTENT;
+		}
+
+		writer.write_uint32(node.tile_index);
+		writer.write_uint32((uint32)node.g);
+		writer.write_uint8(node.flags);
+		writer.write_uint8(saved_flags);
+	});
 }
 
 
-/// Update the Node's g and h values, as well as its previous node.
+/// Replace the nodes of a new frontier with the nodes written by save_frontier(), and open them again.
 /**
- * @param[in] adjacent_node
- * @return True if the new values are lower than the previous ones.
+ * The route is followed back through the previous tiles of the nodes, so every reached node must lead back to the
+ * start of the frontier. Its previous tile must be a reached node of the same frontier with a lower cost, which
+ * rules out loops, and only the start node may have no previous tile. Each tile may be saved once only, since an
+ * open node would otherwise be pushed onto the open nodes twice, and the start node must have been reached. The
+ * reader fails if any of this doesn't hold.
+ * @param[in] reader The reader to read the nodes from.
+ * @param[in] frontier The frontier to load the nodes into. Its start node is among the saved nodes.
+ * @param[in] start The tile the frontier searches from.
  */
-bool Path::Node::update_costs(const Node& adjacent_node)
+template<class MapAccess>
+void BasicPath<MapAccess>::load_frontier(SaveReader& reader, Frontier& frontier, const TileIndex start)
 {
-    int32 new_g = adjacent_node.g + 1;
+	OpenNodeHeap& open_nodes = frontier.open_nodes();
+	open_nodes.clear();
 
-    int32 new_f = new_g + h;
+	const uint32 weight = reader.read_uint32();
+	const uint32 node_count = reader.read_uint32();
 
-    // If this node is closed but cheaper than it was via previous path, or
-    // if this is a new node (f == -1), return true to indicate the node should be opened again
-    if(new_f < f || f == -1)
-    {
-        g = new_g;
-        f = new_f;
-        previous_tile_index = adjacent_node.tile_index;
-        return true;
-    }
+	if(weight < OpenNodeHeap::WEIGHT_UNIT)
+	{
+		reader.fail();
+		return;
+	}
+
+	open_nodes.set_weight(weight);
+
+	// The start node is already there, and is read again like every other node
+	Node& start_node = get_node(frontier, start);
+	start_node.flags = 0;
+	start_node.heap_index = Node::NOT_IN_HEAP;
+	bool start_loaded = false;
+
+	for(uint32 index = 0; index < node_count && !reader.failed(); index++)
+	{
+		const TileIndex tile_index = reader.read_tile();
+		const uint32 previous_node_count = frontier.node_count;
+		Node& node = get_node(frontier, tile_index);
+
+		if(&node == &start_node && !start_loaded)
+		{
+			start_loaded = true;
+		}
+		else if(frontier.node_count == previous_node_count)
+		{
+			reader.fail();
+			break;
+		}
+
+		node.g = (int32)reader.read_uint32();
+		node.flags = reader.read_uint8();
+		node.heap_index = Node::NOT_IN_HEAP;
+
+		const uint8 saved_flags = reader.read_uint8();
+
+		if((saved_flags & SAVED_OPEN) != 0)
+		{
+			open_nodes.push(&node);
+		}
+
+		if((saved_flags & SAVED_INCONSISTENT) != 0)
+		{
+			m_inconsistent_nodes.push_back(&node);
+		}
+
+		if(m_search_mode == ANYTIME && node.closed())
+		{
+			m_closed_nodes.push_back(&node);
+		}
+	}
+
+	if(reader.failed() || !start_loaded || !start_node.reached())
+	{
+		reader.fail();
+		return;
+	}
+
+	bool valid = true;
+
+	frontier.nodes->for_each([&](const Node& node)
+	{
+		if(!node.reached())
+		{
+			return;
+		}
+
+		const TileIndex previous_tile_index = node.previous_tile_index();
+
+		if(previous_tile_index == INVALID_TILE)
+		{
+			valid = valid && node.tile_index == start;
+			return;
+		}
 
-    return false;
+		const Node* previous_node = previous_tile_index < MapSize() ? frontier.nodes->find(previous_tile_index) : nullptr;
+		valid = valid && previous_node != nullptr && previous_node->reached() && previous_node->g < node.g;
+	});
+
+	if(!valid)
+	{
+		reader.fail();
+	}
 }
+
+
+/// Return true if the route runs from the end tile back to the start tile, through tiles next to each other.
+template<class MapAccess>
+bool BasicPath<MapAccess>::route_is_valid() const
+{
+	if(m_route.empty() || m_route.front() != m_end_tile_index || m_route.back() != m_start_tile_index)
+	{
+		return false;
+	}
+
+	for(size_t index = 1; index < m_route.size(); index++)
+	{
+		if(m_map_access.distance(m_route[index - 1], m_route[index]) != 1)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/// Return true if a tile is where a route back to the start of a frontier can begin.
+/**
+ * @param[in] frontier The frontier whose nodes have been checked by load_frontier().
+ * @param[in] tile_index The tile, or INVALID_TILE for a route that has no tiles in this frontier.
+ */
+template<class MapAccess>
+bool BasicPath<MapAccess>::leads_to_start(Frontier& frontier, const TileIndex tile_index)
+{
+	if(tile_index == INVALID_TILE)
+	{
+		return true;
+	}
+
+	const Node* node = tile_index < MapSize() ? frontier.nodes->find(tile_index) : nullptr;
+	return node != nullptr && node->reached();
+}
+
+
+// Only these map access policies are used, so the template doesn't have to live in the header
+template class EmpireAI::BasicPath<DirectMapAccess>;
+template class EmpireAI::BasicPath<SnapshotMapAccess>;
+template class EmpireAI::BasicPath<ScriptMapAccess>;
@@ -4,19 +4,23 @@
 
 
 #include "stdafx.h"
-#include "command_func.h"
 #include "tile_type.h"
-#include <queue>
-#include <unordered_map>
+#include "corridor.hh"
+#include "landmark_map.hh"
+#include "map_access.hh"
+#include "node_store.hh"
+#include "save_buffer.hh"
+#include <iterator>
+#include <memory>
+#include <vector>
 
 
 namespace EmpireAI
 {
 	/**
-	 * Pathfinder class that uses the A* algorithm to find the shortest path of a potential road
-	 * between two map tiles.
+	 * Types shared by every BasicPath, whichever way it reads the map.
 	 */
-	class Path
+	class PathTypes
 	{
 	public:
 
@@ -30,68 +34,171 @@ namespace EmpireAI
 			UNREACHABLE  ///< Pathfinder was unable to find a path.
 		};
 
-		Path(const TileIndex start, const TileIndex end);
+		/**
+		 * Enum representing how the pathfinder searches, and from which ends of the path.
+		 */
+		enum SearchMode
+		{
+			FORWARD,       ///< Search from the start tile towards the end tile.
+			BIDIRECTIONAL, ///< Search from both tiles at once and join the two searches where they meet.
+			ANYTIME        ///< Search forward for a path that may be longer than the shortest, then keep improving it.
+		};
+	};
+
+
+	/**
+	 * Pathfinder class that uses the A* algorithm to find the shortest path of a potential road
+	 * between two map tiles.
+	 *
+	 * The map is read through a MapAccess policy, chosen at compile time so that its functions are inlined into the
+	 * search loop. See DirectMapAccess, SnapshotMapAccess and ScriptMapAccess. Most code uses the Path typedef below.
+	 *
+	 * In ANYTIME mode the search is ARA*: the heuristic is inflated at first, so a path is found after expanding
+	 * far fewer nodes, but it may be up to that factor longer than the shortest path. Each time a path is found
+	 * the weight is lowered and the search carries on from the nodes it already has, until the path is the
+	 * shortest. The caller can accept the current path at any time once its suboptimality bound is low enough.
+	 */
+	template<class MapAccess>
+	class BasicPath : public PathTypes
+	{
+	public:
+
+		BasicPath(const TileIndex start, const TileIndex end, const SearchMode search_mode = FORWARD,
+			const MapAccess& map_access = MapAccess());
+		~BasicPath();
+		BasicPath(const BasicPath&) = delete;
+		BasicPath& operator=(const BasicPath&) = delete;
 		Status find(const uint16_t max_node_count = DEFAULT_NODE_COUNT_PER_FIND);
 
+		void set_corridor(const Corridor& corridor);
+		bool has_corridor() const;
+
+		/// The corridor the search is confined to, or nullptr if it may go anywhere.
+		const Corridor* corridor() const
+		{
+			return m_corridor.get();
+		}
+
+		void set_landmarks(const std::shared_ptr<const LandmarkTables>& landmarks);
+
+		/// Number of nodes the search has expanded so far.
+		uint32 expanded_node_count() const
+		{
+			return m_expanded_node_count;
+		}
+
+		void seed_route(const std::vector<TileIndex>& route);
+		void set_route(const std::vector<TileIndex>& route);
+
+		/// Return true once a path is known, even if an ANYTIME search is still improving it.
+		bool has_route() const
+		{
+			return !m_route.empty();
+		}
+
+		/// Factor by which the current path may be longer than the shortest path. It is 1 for the shortest path.
+		double suboptimality_bound() const
+		{
+			return m_suboptimality_bound;
+		}
+
+		void accept_route();
+
+		void save(SaveWriter& writer);
+		static BasicPath* load(SaveReader& reader, const std::shared_ptr<const LandmarkTables>& landmarks,
+			const MapAccess& map_access = MapAccess());
+
 	private:
 
+		typedef PathNode Node;
+
 		/**
-		 * Path node representing one tile on the map.
+		 * One direction of the search, with every node it has reached and its open nodes.
 		 */
-	    struct Node
-	    {
-	        Node(TileIndex in_tile_index, int32 in_h)
-	        : tile_index(in_tile_index), h(in_h)
-	        {
-	        }
-
-	        Node()
-	        : tile_index(0), h(0)
-	        {}
-
-	        /**
-	         * Compare the cost of this node with another node. If the f cost is the same,
-	         * consider the node with the lower h cost to be cheaper.
-	         * @param other
-	         * @return
-	         */
-	        bool operator>(const Node& other) const
-	        {
-	        	if(f == other.f && h > other.h)
-				{
-					return true;
-				}
-
-				return true ? f > other.f : false;
-	        }
-
-	        bool update_costs(const Node& adjacent_node);
-
-	        TileIndex tile_index; ///< The tile that this node represents.
-	        TileIndex previous_tile_index = INVALID_TILE; ///< The tile that directly preceeds this node in the current path.
-	        int32 g = 0; ///< Cost of the path from the start node to this node.
-	        int32 h; ///< Cost of the path from this node to the end node.
-	        int32 f = -1; ///< Cost of the total path from start to end via this node.
-	    };
-
-		void parse_adjacent_tile(const Node& current_node, const int8 x, const int8 y);
-		Node get_node(const TileIndex tile_index);
-		Node cheapest_open_node(bool& success);
-		bool nodes_can_connect_road(const Node& node_from, const Node& node_to);
+		struct Frontier
+		{
+			NodeStore* nodes = nullptr; ///< Every node reached by this frontier, and its open nodes. Taken from the pool.
+			uint32 node_count = 0; ///< Number of nodes stored in nodes.
+			TileIndex target_tile_index = INVALID_TILE; ///< The tile this frontier is searching towards.
+			const LandmarkTables::Range* target_landmark_distances = nullptr; ///< Distances of the target tile from the landmarks, if used.
+
+			/// The open nodes of this frontier, cheapest first.
+			OpenNodeHeap& open_nodes()
+			{
+				return nodes->open_nodes();
+			}
+		};
+
+		void start_frontier(Frontier& frontier, const TileIndex start, const TileIndex target);
+		void release_frontier(Frontier& frontier);
+		Frontier& next_frontier();
+		bool frontiers_have_met();
+		void check_meeting(const Frontier& frontier, const Node& current_node, const TileIndex meeting_tile_index);
+
+		template<int8 X, int8 Y>
+		void parse_adjacent_tile(Frontier& frontier, const Node& current_node);
+		Node& get_node(Frontier& frontier, const TileIndex tile_index);
+		Node* cheapest_open_node(Frontier& frontier);
+		bool nodes_can_connect_road(const Node& node_from, const TileIndex tile_to);
+		bool tile_can_connect_road(const TileIndex tile, const TileIndex tile_from, const TileIndex tile_to);
+
+		bool end_reached_at_least_cost();
+		void finish_iteration();
+		void finish_search();
+
+		void build_route();
+		void append_route(const Frontier& frontier, TileIndex tile_index);
+
+		void save_frontier(SaveWriter& writer, Frontier& frontier);
+		void load_frontier(SaveReader& reader, Frontier& frontier, const TileIndex start);
+		bool leads_to_start(Frontier& frontier, const TileIndex tile_index);
+		bool route_is_valid() const;
 
 		/// Check up to this many nodes per call of find() by default
 		static const uint16 DEFAULT_NODE_COUNT_PER_FIND = 20;
 
-		void open_node(const Node& node);
-		void close_node(const Node& node);
+		/// Meeting cost before the two frontiers of a bidirectional search have met
+		static const int32 NOT_MET = INT32_MAX;
+
+		/// Weight of the heuristic for the first path of an ANYTIME search, and how much it drops after each path
+		static const uint32 ANYTIME_INITIAL_WEIGHT = 3 * OpenNodeHeap::WEIGHT_UNIT / 2;
+		static const uint32 ANYTIME_WEIGHT_STEP = OpenNodeHeap::WEIGHT_UNIT / 2;
+
+		/// Saved suboptimality bounds are fixed point numbers with this many steps per unit
+		static const uint32 SAVED_BOUND_UNIT = 1 << 16;
+
+		/// What a saved node was to the search, besides its own flags
+		static const uint8 SAVED_OPEN = 0x01;
+		static const uint8 SAVED_INCONSISTENT = 0x02;
+
+		void open_node(Frontier& frontier, Node& node);
+		void close_node(Node& node);
+
+		MapAccess m_map_access;
 
 		Status m_status;
+		SearchMode m_search_mode;
+		uint32 m_expanded_node_count;
 
 		const TileIndex m_start_tile_index;
 		const TileIndex m_end_tile_index;
 
-		std::unordered_map<TileIndex, Node> m_closed_nodes; ///< The list of closed nodes.
-		std::priority_queue<Node, std::vector<Node>, std::greater<Node>> m_open_nodes; ///< The list of open nodes.
+		Frontier m_forward_frontier; ///< Searches from the start tile towards the end tile.
+		Frontier m_backward_frontier; ///< Searches from the end tile towards the start tile, in bidirectional mode only.
+
+		int32 m_meeting_cost; ///< Length of the shortest path found so far through a tile reached by both frontiers.
+		TileIndex m_meeting_tile_index; ///< The tile where the two frontiers meet on that path.
+		TileIndex m_meeting_forward_tile_index; ///< Tile before the meeting tile, reached by the forward frontier.
+		TileIndex m_meeting_backward_tile_index; ///< Tile after the meeting tile, reached by the backward frontier.
+
+		double m_suboptimality_bound; ///< See suboptimality_bound().
+		std::vector<Node*> m_closed_nodes; ///< Nodes expanded since the last path of an ANYTIME search was found.
+		std::vector<Node*> m_inconsistent_nodes; ///< Closed nodes that have become cheaper since they were expanded.
+
+		std::unique_ptr<Corridor> m_corridor; ///< If set, the search doesn't leave the clusters of this corridor.
+		std::shared_ptr<const LandmarkTables> m_landmarks; ///< If set, the heuristic also takes the landmark bounds.
+
+		std::vector<TileIndex> m_route; ///< The path once found, from the end tile back to the start tile.
 
 	public:
 
@@ -102,61 +209,84 @@ namespace EmpireAI
         {
         public:
 
-            Iterator(std::unordered_map<TileIndex, Node>& node_map, TileIndex tile_index)
-            : m_node_map(node_map), m_tile_index(tile_index)
+            typedef std::bidirectional_iterator_tag iterator_category;
+            typedef TileIndex value_type;
+            typedef std::ptrdiff_t difference_type;
+            typedef const TileIndex* pointer;
+            typedef TileIndex reference;
+
+            Iterator(const std::vector<TileIndex>& route, size_t position)
+            : m_route(&route), m_position(position)
             {}
 
             bool operator==(const Iterator& iterator) const
             {
-                return m_tile_index == iterator.m_tile_index;
+                return m_position == iterator.m_position;
             }
 
             bool operator!=(const Iterator& iterator) const
             {
-                return m_tile_index != iterator.m_tile_index;
+                return m_position != iterator.m_position;
             }
 
-            const Iterator& operator=(const TileIndex tile_index)
+            const Iterator& operator++()
             {
-            	m_tile_index = tile_index;
+            	m_position++;
                 return *this;
             }
 
-            const Iterator& operator++()
+            Iterator operator++(int)
             {
-            	m_tile_index = m_node_map[m_tile_index].previous_tile_index;
+                Iterator iterator = *this;
+                m_position++;
+                return iterator;
+            }
+
+            const Iterator& operator--()
+            {
+                m_position--;
                 return *this;
             }
 
-            Iterator operator++(int)
+            Iterator operator--(int)
             {
                 Iterator iterator = *this;
-                m_tile_index = m_node_map[m_tile_index].previous_tile_index;
+                m_position--;
                 return iterator;
             }
 
             TileIndex operator*() const
             {
-                return m_tile_index;
+                return (*m_route)[m_position];
             }
 
         private:
-            std::unordered_map<TileIndex, Node>& m_node_map;
-            TileIndex m_tile_index;
+            const std::vector<TileIndex>* m_route;
+            size_t m_position;
         };
 
         Iterator begin()
         {
             // Path is traversed in reverse order of discovery, so begin returns the end tile
-            return Iterator(m_closed_nodes, m_end_tile_index);
+            return Iterator(m_route, 0);
         }
 
         Iterator end()
         {
             // Path is traversed in reverse order of discovery, so end returns one past the start tile
-            return Iterator(m_closed_nodes, INVALID_TILE);
+            return Iterator(m_route, m_route.size());
+        }
+
+        /// Number of tiles in the path, once it has been found.
+        size_t length() const
+        {
+            return m_route.size();
         }
 	};
+
+
+	/// The pathfinder used by the AI, which reads the map directly.
+	typedef BasicPath<DirectMapAccess> Path;
 }
 
 
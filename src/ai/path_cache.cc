@@ -0,0 +1,281 @@
+/// \file
+#include "path_cache.hh"
+#include "connectivity_cache.hh"
+
+#include "map_func.h"
+
+#include <algorithm>
+
+using namespace EmpireAI;
+
+
+PathCache::PathCache()
+: m_map_size(0)
+{
+}
+
+
+/// Store the route of a path that has been found.
+/**
+ * @param[in] path The path. Its search must have finished with FOUND.
+ */
+void PathCache::insert(Path& path)
+{
+    if(path.length() < 2)
+    {
+        return;
+    }
+
+    std::vector<TileIndex> route;
+
+    for(Path::Iterator iterator = path.begin(); iterator != path.end(); iterator++)
+    {
+        route.push_back(*iterator);
+    }
+
+    Entry entry;
+    entry.first_tile_index = route.front();
+    entry.last_tile_index = route.back();
+    entry.tile_count = route.size();
+    entry.steps.assign((route.size() + 2) / 4, 0);
+    entry.min_x = entry.max_x = TileX(route.front());
+    entry.min_y = entry.max_y = TileY(route.front());
+
+    const int32 row = TileDiffXY(0, 1);
+
+    for(size_t index = 1; index < route.size(); index++)
+    {
+        const int32 difference = (int32)(route[index] - route[index - 1]);
+        const uint8 direction = difference == 1 ? 0 : difference == -1 ? 1 : difference == row ? 2 : 3;
+
+        const size_t step = index - 1;
+        entry.steps[step / 4] |= direction << ((step % 4) * 2);
+
+        entry.min_x = std::min(entry.min_x, TileX(route[index]));
+        entry.min_y = std::min(entry.min_y, TileY(route[index]));
+        entry.max_x = std::max(entry.max_x, TileX(route[index]));
+        entry.max_y = std::max(entry.max_y, TileY(route[index]));
+    }
+
+    // A newer route between the same tiles replaces the old one
+    for(size_t entry_index = 0; entry_index < m_entries.size(); entry_index++)
+    {
+        const Entry& old_entry = m_entries[entry_index];
+
+        if((old_entry.first_tile_index == entry.first_tile_index && old_entry.last_tile_index == entry.last_tile_index) ||
+            (old_entry.first_tile_index == entry.last_tile_index && old_entry.last_tile_index == entry.first_tile_index))
+        {
+            erase(entry_index);
+            break;
+        }
+    }
+
+    if(m_entries.size() == MAX_ENTRY_COUNT)
+    {
+        erase(0);
+    }
+
+    m_entries.push_back(entry);
+    count_tiles(route, 1);
+}
+
+
+/// Get the cached route between two tiles.
+/**
+ * @param[in] start The tile at the start of the route.
+ * @param[in] end The tile at the end of the route.
+ * @param[out] route The route, from start to end.
+ * @return True if a route that can still be used was found.
+ */
+bool PathCache::find_route(const TileIndex start, const TileIndex end, std::vector<TileIndex>& route)
+{
+    for(size_t entry_index = 0; entry_index < m_entries.size(); entry_index++)
+    {
+        Entry& entry = m_entries[entry_index];
+        const bool forward = entry.first_tile_index == start && entry.last_tile_index == end;
+        const bool backward = entry.first_tile_index == end && entry.last_tile_index == start;
+
+        if(!forward && !backward)
+        {
+            continue;
+        }
+
+        if(!check(entry, route))
+        {
+            erase(entry_index);
+            return false;
+        }
+
+        if(backward)
+        {
+            std::reverse(route.begin(), route.end());
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+
+/// Get every cached route with an end at a tile.
+/**
+ * @param[in] start The tile to find routes from.
+ * @param[out] routes The routes, each starting at the start tile.
+ */
+void PathCache::routes_from(const TileIndex start, std::vector<std::vector<TileIndex>>& routes)
+{
+    routes.clear();
+
+    for(size_t entry_index = 0; entry_index < m_entries.size(); )
+    {
+        Entry& entry = m_entries[entry_index];
+
+        if(entry.first_tile_index != start && entry.last_tile_index != start)
+        {
+            entry_index++;
+            continue;
+        }
+
+        std::vector<TileIndex> route;
+
+        if(!check(entry, route))
+        {
+            erase(entry_index);
+            continue;
+        }
+
+        if(entry.last_tile_index == start)
+        {
+            std::reverse(route.begin(), route.end());
+        }
+
+        routes.push_back(route);
+        entry_index++;
+    }
+}
+
+
+/// Mark the routes through a changed tile as changed, so that they are checked before they are used again.
+void PathCache::tile_changed(TileIndex tile)
+{
+    // A tile of a new, larger map may change before the cache has been used on it
+    reset_if_map_changed();
+
+    const uint16* route_count = m_route_counts.find(tile);
+
+    if(route_count == nullptr || *route_count == 0)
+    {
+        return;
+    }
+
+    const uint32 x = TileX(tile);
+    const uint32 y = TileY(tile);
+
+    // The bounding box may also catch routes that only pass nearby, which then get an extra check
+    for(Entry& entry : m_entries)
+    {
+        if(x >= entry.min_x && x <= entry.max_x && y >= entry.min_y && y <= entry.max_y)
+        {
+            entry.changed = true;
+        }
+    }
+}
+
+
+/// Drop every route if a game with a different map size has been started.
+void PathCache::reset_if_map_changed()
+{
+    if(m_map_size == MapSize())
+    {
+        return;
+    }
+
+    m_map_size = MapSize();
+    m_entries.clear();
+    m_route_counts.fit_to_map();
+}
+
+
+/// Expand a route from its compact form.
+/**
+ * @param[in] entry The cached route.
+ * @param[out] route Every tile of the route, from its first tile to its last tile.
+ */
+void PathCache::decode(const Entry& entry, std::vector<TileIndex>& route) const
+{
+    const int32 offsets[] = {1, -1, TileDiffXY(0, 1), -TileDiffXY(0, 1)};
+
+    route.resize(entry.tile_count);
+    route[0] = entry.first_tile_index;
+
+    for(uint32 index = 1; index < entry.tile_count; index++)
+    {
+        const uint32 step = index - 1;
+        const uint8 direction = (entry.steps[step / 4] >> ((step % 4) * 2)) & 3;
+
+        route[index] = route[index - 1] + offsets[direction];
+    }
+}
+
+
+/// Expand a route, checking it against the live map first if one of its tiles has changed.
+/**
+ * @param[in] entry The cached route.
+ * @param[out] route Every tile of the route, from its first tile to its last tile.
+ * @return True if the route can still be used.
+ */
+bool PathCache::check(Entry& entry, std::vector<TileIndex>& route)
+{
+    decode(entry, route);
+
+    if(entry.changed)
+    {
+        if(!route_is_valid(route))
+        {
+            return false;
+        }
+
+        entry.changed = false;
+    }
+
+    return true;
+}
+
+
+void PathCache::erase(const size_t entry_index)
+{
+    std::vector<TileIndex> route;
+    decode(m_entries[entry_index], route);
+    count_tiles(route, -1);
+
+    m_entries.erase(m_entries.begin() + entry_index);
+}
+
+
+/// Add to or subtract from the number of cached routes through each tile of a route.
+void PathCache::count_tiles(const std::vector<TileIndex>& route, const int32 change)
+{
+    for(const TileIndex tile_index : route)
+    {
+        m_route_counts[tile_index] += change;
+    }
+}
+
+
+/// Check that a road can still be built along every tile of a route on the live map.
+bool PathCache::route_is_valid(const std::vector<TileIndex>& route) const
+{
+    ConnectivityCache* connectivity = ConnectivityCache::instance();
+
+    // Like a search, the tiles at either end only have to connect in one direction
+    for(size_t index = 1; index + 1 < route.size(); index++)
+    {
+        if(!connectivity->can_build_road_through(route[index], route[index - 1], route[index + 1]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
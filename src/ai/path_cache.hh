@@ -0,0 +1,76 @@
+/// \file
+#ifndef PATH_CACHE_HH
+#define PATH_CACHE_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "map_change_listener.hh"
+#include "paged_tile_array.hh"
+#include "path.hh"
+#include <deque>
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Keeps the routes of finished searches, so that later searches can reuse them.
+     *
+     * Routes are stored by their end tiles, as the first tile and a 2-bit direction per step. A search between
+     * the same two tiles gets the whole route back. A search from a tile where cached routes end is seeded with
+     * those routes, so in a hub-and-spoke network it only has to find the short branch from an existing route to
+     * the new town.
+     *
+     * Building along a route changes its tiles without making it any less usable, so a route isn't dropped as
+     * soon as one of its tiles changes. It is marked as changed, checked against the live map the next time it
+     * is asked for, and dropped then if a road can no longer follow it.
+     */
+    class PathCache : public MapChangeListener
+    {
+    public:
+
+        PathCache();
+
+        void reset_if_map_changed();
+
+        void insert(Path& path);
+
+        bool find_route(const TileIndex start, const TileIndex end, std::vector<TileIndex>& route);
+        void routes_from(const TileIndex start, std::vector<std::vector<TileIndex>>& routes);
+
+        void tile_changed(TileIndex tile) override;
+
+    private:
+
+        /**
+         * A cached route, in compact form.
+         */
+        struct Entry
+        {
+            TileIndex first_tile_index;
+            TileIndex last_tile_index;
+            uint32 tile_count;
+            std::vector<uint8> steps; ///< Direction of each step from one tile to the next, four per byte.
+            uint32 min_x, min_y, max_x, max_y; ///< Bounding box of the route, to find routes through a tile.
+            bool changed = false;     ///< True if one of its tiles has changed since the route was last checked.
+        };
+
+        void decode(const Entry& entry, std::vector<TileIndex>& route) const;
+        bool check(Entry& entry, std::vector<TileIndex>& route);
+        void erase(const size_t entry_index);
+        void count_tiles(const std::vector<TileIndex>& route, const int32 change);
+        bool route_is_valid(const std::vector<TileIndex>& route) const;
+
+        /// The oldest routes are dropped once there are more than this many
+        static const size_t MAX_ENTRY_COUNT = 64;
+
+        std::deque<Entry> m_entries; ///< Cached routes, oldest first.
+
+        PagedTileArray<uint16> m_route_counts; ///< Number of cached routes through each tile.
+        uint32 m_map_size;
+    };
+}
+
+
+#endif // PATH_CACHE_HH
@@ -0,0 +1,143 @@
+/// \file
+#ifndef PATH_NODE_HH
+#define PATH_NODE_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "map_func.h"
+
+
+namespace EmpireAI
+{
+    /**
+     * Path node representing one tile on the map.
+     *
+     * Nodes are packed into 16 bytes, since a search stores one for every tile it reaches. The previous tile is
+     * always adjacent, so only its direction is kept. The f cost is worked out from g and h when needed, and h fits
+     * in 16 bits because no two tiles of an OpenTTD map are further apart than that.
+     */
+    struct PathNode
+    {
+        PathNode(TileIndex in_tile_index, uint32 in_h)
+        : tile_index(in_tile_index), h((uint16)in_h)
+        {
+        }
+
+        PathNode()
+        : tile_index(0), h(0)
+        {}
+
+        /**
+         * Compare the cost of this node with another node. If the f cost is the same,
+         * consider the node with the lower h cost to be cheaper.
+         * @param other
+         * @return True if this node is cheaper than the other node.
+         */
+        bool operator<(const PathNode& other) const
+        {
+            if(f() == other.f())
+            {
+                return h < other.h;
+            }
+
+            return f() < other.f();
+        }
+
+        /// Cost of the total path from start to end via this node.
+        int32 f() const
+        {
+            return g + h;
+        }
+
+        /// Return true once the search has found a path to this node.
+        bool reached() const
+        {
+            return (flags & REACHED) != 0;
+        }
+
+        /// Record that the search has found a path to this node, with the cost already set in g.
+        void set_reached()
+        {
+            flags |= REACHED;
+        }
+
+        /// Return true once this node has been expanded.
+        bool closed() const
+        {
+            return (flags & CLOSED) != 0;
+        }
+
+        void set_closed(const bool closed)
+        {
+            flags = closed ? flags | CLOSED : flags & ~CLOSED;
+        }
+
+        /// Return the tile that directly precedes this node in the current path, or INVALID_TILE for a start node.
+        TileIndex previous_tile_index() const
+        {
+            if((flags & HAS_PREVIOUS) == 0)
+            {
+                return INVALID_TILE;
+            }
+
+            // Same order as ConnectivityCache directions: +x, -x, +y and -y
+            const int32 row = (int32)MapSizeX();
+            const int32 offsets[] = {1, -1, row, -row};
+
+            return tile_index + offsets[flags & DIRECTION_MASK];
+        }
+
+        /// Set the tile that directly precedes this node in the current path. It must be adjacent to this node.
+        void set_previous_tile_index(const TileIndex previous_tile_index)
+        {
+            const int32 difference = (int32)(previous_tile_index - tile_index);
+            const uint8 direction = difference == 1 ? 0 : difference == -1 ? 1 : difference > 0 ? 2 : 3;
+
+            flags = (flags & ~DIRECTION_MASK) | HAS_PREVIOUS | direction;
+        }
+
+        /// Update the Node's g value, as well as its previous node.
+        /**
+         * @param[in] adjacent_node
+         * @return True if the new cost is lower than the previous one.
+         */
+        bool update_costs(const PathNode& adjacent_node)
+        {
+            int32 new_g = adjacent_node.g + 1;
+
+            // If this node is closed but cheaper than it was via previous path, or
+            // if this is a new node, return true to indicate the node should be opened again
+            if(new_g < g || !reached())
+            {
+                g = new_g;
+                set_reached();
+                set_previous_tile_index(adjacent_node.tile_index);
+                return true;
+            }
+
+            return false;
+        }
+
+        TileIndex tile_index; ///< The tile that this node represents.
+        int32 g = 0; ///< Cost of the path from the start node to this node.
+        uint32 heap_index = NOT_IN_HEAP; ///< Position of this node in the open node heap.
+        uint16 h; ///< Cost of the path from this node to the end node.
+        uint8 flags = 0; ///< Direction of the previous tile, and the flags below.
+        uint8 generation = 0; ///< Search that stored this node, for use by NodeStore. 0 is never a valid generation.
+
+        static const uint32 NOT_IN_HEAP = UINT32_MAX; ///< heap_index of a node that is not open.
+
+    private:
+
+        static const uint8 DIRECTION_MASK = 0x03; ///< Direction of the previous tile, see previous_tile_index().
+        static const uint8 HAS_PREVIOUS = 0x04;   ///< Set unless this is a start node.
+        static const uint8 REACHED = 0x08;
+        static const uint8 CLOSED = 0x10;
+    };
+
+    static_assert(sizeof(PathNode) == 16, "PathNode should stay packed into 16 bytes");
+}
+
+
+#endif // PATH_NODE_HH
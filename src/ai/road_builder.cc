@@ -1,35 +1,373 @@
 #include "road_builder.hh"
+#include "connectivity_cache.hh"
+#include "corridor.hh"
+#include "landmark_map.hh"
+#include "map_change_listener.hh"
+#include "metrics.hh"
 #include "openttd_functions.hh"
 
+#include "map_func.h"
+
+#include <algorithm>
+#include <unordered_map>
+
 using namespace EmpireAI;
 
 
 RoadBuilder::RoadBuilder(Path& path)
 : m_path(path),
-  m_previous_path_iterator(path.begin()),
-  m_current_path_iterator(path.begin())
+  m_tiles(path.begin(), path.end()),
+  m_next_item(0),
+  m_next_position(0),
+  m_plan_checked(false),
+  m_repair_position(0),
+  m_repair_count(0)
+{
+    plan_runs(0);
+}
+
+
+bool RoadBuilder::check_plan()
+{
+    Metrics::count(Metrics::ROAD_PLANS_CHECKED);
+    m_plan_checked = true;
+
+    if(m_plan.check())
+    {
+        return true;
+    }
+
+    // An AI's road command stops at the first tile that fails, so a run that can't be built as a whole
+    // might still be buildable piece by piece
+    ConstructionPlan plan;
+
+    for(size_t index = 0; index < m_plan.size(); index++)
+    {
+        const ConstructionPlan::Item& run = m_plan.item(index);
+
+        if(run.feasible)
+        {
+            plan.add_item(run);
+        }
+        else
+        {
+            add_road_tile_by_tile(plan, run);
+        }
+    }
+
+    m_plan = plan;
+
+    if(m_plan.check())
+    {
+        return true;
+    }
+
+    // A run that can't be built is searched around the same way as a run that fails to build, before anything
+    // is built, and the plan is checked again once the route has been repaired
+    for(size_t index = 0; index < m_plan.size(); index++)
+    {
+        if(!m_plan.item(index).feasible)
+        {
+            if(start_repair(m_plan.item(index)))
+            {
+                return true;
+            }
+
+            break;
+        }
+    }
+
+    Metrics::count(Metrics::ROAD_PLANS_REJECTED);
+    return false;
+}
+
+
+RoadBuilder::Status RoadBuilder::build_road_segment()
 {
+    if(m_repair_path)
+    {
+        return continue_repair();
+    }
+
+    // A repaired route is checked as a whole again before any of it is built
+    if(!m_plan_checked)
+    {
+        if(!check_plan())
+        {
+            return FAILED;
+        }
+
+        if(m_repair_path)
+        {
+            return IN_PROGRESS;
+        }
+    }
+
+    if(m_next_item == m_plan.size())
+    {
+        return BUILT;
+    }
+
+    const ConstructionPlan::Item item = m_plan.item(m_next_item);
 
+    if(m_plan.build_item(m_next_item))
+    {
+        Metrics::count(Metrics::ROAD_SEGMENTS_BUILT);
+        m_next_item++;
+        m_next_position = std::find(m_tiles.begin() + m_next_position, m_tiles.end(), item.other_tile_index) - m_tiles.begin();
+        return IN_PROGRESS;
+    }
+
+    Metrics::count(Metrics::ROAD_SEGMENTS_FAILED);
+
+    return start_repair(item) ? IN_PROGRESS : FAILED;
 }
 
 
-bool RoadBuilder::build_road_segment()
+void RoadBuilder::save(SaveWriter& writer)
 {
-    // If the current and previous iterators are the same, we're at the beginning of the path
-    if(m_current_path_iterator == m_previous_path_iterator)
+    writer.write_uint32((uint32)m_next_position);
+    writer.write_uint32(m_repair_count);
+    writer.write_uint8(m_repair_path != nullptr);
+
+    if(m_repair_path)
     {
-        m_current_path_iterator++;
+        writer.write_uint32((uint32)m_repair_position);
+        m_repair_path->save(writer);
     }
+}
 
-    // Build one segment of road
-    if(m_current_path_iterator != m_path.end())
+
+bool RoadBuilder::load(SaveReader& reader)
+{
+    const size_t next_position = reader.read_uint32();
+    m_repair_count = reader.read_uint32();
+
+    if(reader.read_uint8() != 0)
     {
-        EmpireAI::build_road(*m_previous_path_iterator, *m_current_path_iterator);
+        m_repair_position = reader.read_uint32();
+        m_repair_path.reset(Path::load(reader, LandmarkMap::instance()->tables()));
+
+        if(m_repair_path == nullptr || m_repair_position >= m_tiles.size())
+        {
+            reader.fail();
+        }
+    }
 
-        m_previous_path_iterator++;
-        m_current_path_iterator++;
+    if(reader.failed() || next_position >= m_tiles.size())
+    {
         return false;
     }
 
+    plan_runs(next_position);
+    m_plan_checked = false;
+
     return true;
 }
+
+
+/// Plan one road command for each straight run of the path, starting at a position of m_tiles.
+void RoadBuilder::plan_runs(const size_t start_position)
+{
+    m_plan = ConstructionPlan();
+    m_next_item = 0;
+    m_next_position = start_position;
+
+    size_t run_start = start_position;
+    size_t run_end = find_run_end(run_start);
+
+    while(run_end != run_start)
+    {
+        m_plan.add_road(m_tiles[run_start], m_tiles[run_end]);
+
+        run_start = run_end;
+        run_end = find_run_end(run_start);
+    }
+}
+
+
+/// Find the last tile of the longest straight run of the path that starts at this tile.
+/**
+ * A run ends where the path turns, or where the slope of the land changes.
+ * @param[in] run_start Position in m_tiles of the first tile of the run.
+ * @return Position of the last tile of the run, or run_start itself if it is the last tile of the path.
+ */
+size_t RoadBuilder::find_run_end(const size_t run_start)
+{
+    if(run_start + 1 >= m_tiles.size())
+    {
+        return run_start;
+    }
+
+    size_t run_end = run_start;
+    size_t next = run_start + 1;
+
+    const TileIndex step = m_tiles[next] - m_tiles[run_start];
+    const uint8 slope = get_tile_slope(m_tiles[run_start]);
+
+    while(next < m_tiles.size() && m_tiles[next] - m_tiles[run_end] == step && get_tile_slope(m_tiles[next]) == slope)
+    {
+        run_end = next;
+        next++;
+    }
+
+    // Always make progress, even if the next tile already has a different slope
+    if(run_end == run_start)
+    {
+        run_end++;
+    }
+
+    return run_end;
+}
+
+
+/// Plan a straight run one pair of adjacent tiles at a time, the way the whole path used to be built.
+void RoadBuilder::add_road_tile_by_tile(ConstructionPlan& plan, const ConstructionPlan::Item& run)
+{
+    const int32 distance_x = (int32)TileX(run.other_tile_index) - (int32)TileX(run.tile_index);
+    const int32 distance_y = (int32)TileY(run.other_tile_index) - (int32)TileY(run.tile_index);
+    const int32 step = TileDiffXY((distance_x > 0) - (distance_x < 0), (distance_y > 0) - (distance_y < 0));
+
+    for(TileIndex tile = run.tile_index; tile != run.other_tile_index; tile += step)
+    {
+        plan.add_road(tile, tile + step);
+    }
+}
+
+
+/// Start searching for a way around the tiles that made an item fail, if the map has changed under it.
+/**
+ * Changes made by other companies and towns aren't reported to the caches, so the tiles of the item are
+ * fetched again first. Only the part of the route from the failed item to the last blocked tile in it is
+ * searched for again. The rest of the route is still valid, so it seeds the search with the costs it already
+ * had, the way an incremental search only re-expands the nodes whose costs a change has made inconsistent.
+ * The search is confined to the clusters around the blocked part, and runs a few nodes per call.
+ * @param[in] failed_item The item that couldn't be built.
+ * @return True if a repair search has been started.
+ */
+bool RoadBuilder::start_repair(const ConstructionPlan::Item& failed_item)
+{
+    if(m_repair_count == MAX_REPAIR_COUNT)
+    {
+        return false;
+    }
+
+    const size_t first = std::find(m_tiles.begin() + m_next_position, m_tiles.end(), failed_item.tile_index) - m_tiles.begin();
+    const size_t last = std::find(m_tiles.begin() + first, m_tiles.end(), failed_item.other_tile_index) - m_tiles.begin();
+
+    if(last >= m_tiles.size())
+    {
+        return false;
+    }
+
+    MapChangeListener::notify_tiles_changed(m_tiles[first], m_tiles[last]);
+
+    // Both ends of the route are kept, as are the tiles already built, so only the tiles in between can be avoided
+    ConnectivityCache* connectivity = ConnectivityCache::instance();
+    size_t last_blocked = 0;
+
+    for(size_t position = std::max(first, (size_t)1); position <= last && position + 1 < m_tiles.size(); position++)
+    {
+        if(!connectivity->can_build_road_through(m_tiles[position], m_tiles[position - 1], m_tiles[position + 1]))
+        {
+            last_blocked = position;
+        }
+    }
+
+    // Nothing in the way, so the road failed for some other reason, such as money
+    if(last_blocked == 0)
+    {
+        return false;
+    }
+
+    Corridor corridor;
+    const int32 clusters_per_row = (int32)(MapSizeX() >> Corridor::CLUSTER_BITS);
+    const int32 cluster_rows = (int32)(MapSizeY() >> Corridor::CLUSTER_BITS);
+
+    for(size_t position = first; position <= last_blocked + 1; position++)
+    {
+        const int32 cluster_x = (int32)(TileX(m_tiles[position]) >> Corridor::CLUSTER_BITS);
+        const int32 cluster_y = (int32)(TileY(m_tiles[position]) >> Corridor::CLUSTER_BITS);
+
+        for(int32 y = std::max(cluster_y - 1, 0); y <= std::min(cluster_y + 1, cluster_rows - 1); y++)
+        {
+            for(int32 x = std::max(cluster_x - 1, 0); x <= std::min(cluster_x + 1, clusters_per_row - 1); x++)
+            {
+                corridor.add_cluster(y * clusters_per_row + x);
+            }
+        }
+    }
+
+    // Search from the far end of the route back to the first tile of the failed item, which is already built,
+    // is the end of the route or comes after runs that are still to be built, so that the unchanged part of the
+    // route can be seeded from its start
+    std::vector<TileIndex> unchanged_route(m_tiles.rbegin(), m_tiles.rend() - (last_blocked + 1));
+
+    m_repair_path.reset(new Path(m_tiles.back(), m_tiles[first]));
+    m_repair_path->set_corridor(corridor);
+    m_repair_path->set_landmarks(LandmarkMap::instance()->tables());
+    m_repair_path->seed_route(unchanged_route);
+    m_repair_position = first;
+    m_repair_count++;
+
+    return true;
+}
+
+
+/// Search for the repaired route for a while, and plan the rest of the road along it once it has been found.
+RoadBuilder::Status RoadBuilder::continue_repair()
+{
+    const Path::Status status = m_repair_path->find(REPAIR_NODES_PER_STEP);
+
+    if(status == Path::IN_PROGRESS)
+    {
+        return IN_PROGRESS;
+    }
+
+    if(status == Path::UNREACHABLE)
+    {
+        Metrics::count(Metrics::ROAD_REPAIRS_FAILED);
+        m_repair_path.reset();
+        return FAILED;
+    }
+
+    Metrics::count(Metrics::ROAD_REPAIRS);
+
+    // The repaired route starts at the first tile of the failed item, but it may pass closer to the start
+    // through a tile of the route before it. It joins the route before it at the last such tile.
+    std::unordered_map<TileIndex, size_t> built_positions;
+
+    for(size_t position = 0; position <= m_repair_position; position++)
+    {
+        built_positions[m_tiles[position]] = position;
+    }
+
+    std::vector<TileIndex> repaired_tiles(m_repair_path->begin(), m_repair_path->end());
+    size_t join_index = 0;
+    size_t join_position = m_repair_position;
+
+    for(size_t index = 0; index < repaired_tiles.size(); index++)
+    {
+        std::unordered_map<TileIndex, size_t>::const_iterator built = built_positions.find(repaired_tiles[index]);
+
+        if(built != built_positions.end())
+        {
+            join_index = index;
+            join_position = built->second;
+        }
+    }
+
+    m_tiles.resize(join_position + 1);
+    m_tiles.insert(m_tiles.end(), repaired_tiles.begin() + join_index + 1, repaired_tiles.end());
+    m_repair_path.reset();
+
+    // The stations are placed along the path, so it has to follow the road that is actually built
+    m_path.set_route(std::vector<TileIndex>(m_tiles.rbegin(), m_tiles.rend()));
+
+    // A repair started by check_plan() comes before anything has been built, so the runs up to the join are
+    // still to be built
+    plan_runs(std::min(join_position, m_next_position));
+    m_plan_checked = false;
+
+    return IN_PROGRESS;
+}
@@ -1,7 +1,12 @@
 #ifndef ROAD_BUILDER_HH
 #define ROAD_BUILDER_HH
 
+#include "construction_plan.hh"
 #include "path.hh"
+#include "save_buffer.hh"
+
+#include <memory>
+#include <vector>
 
 namespace EmpireAI
 {
@@ -10,17 +15,65 @@ namespace EmpireAI
     {
     public:
 
+        enum Status
+        {
+            IN_PROGRESS, // More segments to build, or a repair of the route is being searched for
+            BUILT,       // The whole road has been built
+            FAILED       // A segment couldn't be built, and the route around it couldn't be repaired
+        };
+
         RoadBuilder(Path& path);
 
-        // Iterates through a path object and builds a road along the path
-        bool build_road_segment();
+        // Checks the whole road in test mode before anything is built. A run that can't be built starts a repair
+        // of the route around it, and the plan is only rejected if the route can't be repaired.
+        bool check_plan();
+
+        // Iterates through a path object and builds a road along the path, one straight run at a time.
+        // If a run can't be built because the map has changed, the route is repaired around the changed
+        // tiles over the next calls, and building carries on along the repaired route.
+        Status build_road_segment();
+
+        // Writes how far the road has been built, and the repair being searched for, if any
+        void save(SaveWriter& writer);
+
+        // Carries on from where save() left off. The road builder must have been created from the saved path.
+        // The rest of the road is checked again before it is built, since the map may have changed meanwhile.
+        bool load(SaveReader& reader);
+
+        // Number of times the route has been repaired
+        uint32 repair_count() const
+        {
+            return m_repair_count;
+        }
 
     private:
 
+        void plan_runs(const size_t start_position);
+        size_t find_run_end(const size_t run_start);
+        void add_road_tile_by_tile(ConstructionPlan& plan, const ConstructionPlan::Item& run);
+
+        bool start_repair(const ConstructionPlan::Item& failed_item);
+        Status continue_repair();
+
+        // Nodes the repair search expands per call of build_road_segment()
+        static const uint16 REPAIR_NODES_PER_STEP = 50;
+
+        // Give up on a road that keeps being built over after this many repairs
+        static const uint32 MAX_REPAIR_COUNT = 3;
+
         Path& m_path;
 
-        Path::Iterator m_previous_path_iterator;
-        Path::Iterator m_current_path_iterator;
+        // Tiles of the path in the order they are built, the same as iterating over m_path
+        std::vector<TileIndex> m_tiles;
+
+        ConstructionPlan m_plan;
+        size_t m_next_item;
+        size_t m_next_position; // Position in m_tiles of the first tile of the next item
+        bool m_plan_checked;
+
+        std::unique_ptr<Path> m_repair_path; // Searches for a new route from the failed item onwards
+        size_t m_repair_position;            // Position in m_tiles where the repaired route joins the old one
+        uint32 m_repair_count;
     };
 }
 
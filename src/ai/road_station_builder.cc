@@ -1,5 +1,9 @@
 #include "road_station_builder.hh"
+#include "metrics.hh"
 #include "openttd_functions.hh"
+#include "passenger_map.hh"
+
+#include <utility>
 
 using namespace EmpireAI;
 
@@ -7,79 +11,204 @@ using namespace EmpireAI;
 RoadStationBuilder::RoadStationBuilder(Path& path)
 : m_path(path)
 {
-
+    // Create an array of TileIndexes corresponding to N,S,E,W offsets
+    m_offsets[0] = EmpireAI::get_tile_index(1, 0);
+    m_offsets[1] = EmpireAI::get_tile_index(-1, 0);
+    m_offsets[2] = EmpireAI::get_tile_index(0, 1);
+    m_offsets[3] = EmpireAI::get_tile_index(0, -1);
 }
 
 
-/// Iterates through a path and builds a bus station as close to the start and end
-/// as possible on tiles that provide and accept passengers. Also builds a road
-/// depot along the same path.
+/// Builds a bus station near each end of the path where it collects the most passengers, and a road depot along the path.
+/**
+ * The path is scanned from both ends towards the middle: the front finds the first station and then the depot, and
+ * the back finds the second station. Once a station has a site, the next STATION_SEARCH_LENGTH tiles are scanned for
+ * a site with more passenger production. The scan stops as soon as all three sites are settled, so its cost depends
+ * on how far the sites are from the ends of the path rather than on the length of the path.
+ * @return True if the stations and the depot were built.
+ */
 bool RoadStationBuilder::build_bus_stations()
 {
-    // Create an array of TileIndexes corresponding to N,S,E,W offsets
-    std::array<TileIndex, 4> offsets;
-    offsets[0] = EmpireAI::get_tile_index(1, 0);
-    offsets[1] = EmpireAI::get_tile_index(-1, 0);
-    offsets[2] = EmpireAI::get_tile_index(0, 1);
-    offsets[3] = EmpireAI::get_tile_index(0, -1);
-
-    TileIndex first_station_tile = INVALID_TILE;
-    TileIndex first_station_offset = INVALID_TILE;
-    TileIndex road_depot_tile = INVALID_TILE;
-    TileIndex road_depot_offset = INVALID_TILE;
-    TileIndex second_station_tile = INVALID_TILE;
-    TileIndex second_station_offset = INVALID_TILE;
-
-    // Follow the path between the two towns and find available tiles for building stations and depot
-    for(Path::Iterator iterator = m_path.begin(); iterator != m_path.end(); iterator++)
+    Site first_station;
+    Site road_depot;
+    Site second_station;
+
+    Path::Iterator front = m_path.begin();
+    Path::Iterator back = m_path.end();
+    size_t front_position = 0;
+    size_t back_position = m_path.length();
+
+    // Every tile is scanned by one side only
+    while(front_position < back_position && !(first_station.settled && road_depot.settled && second_station.settled))
     {
-        // Check tiles adjacent to the road for ability to support stations and provide passengers
-        for(const TileIndex offset : offsets)
+        if(!first_station.settled || !road_depot.settled)
         {
-            if(can_build_road_building(*iterator + offset, *iterator) && can_build_road(*iterator + offset, *iterator))
+            if(!first_station.settled)
+            {
+                find_site(*front, true, first_station, {&road_depot, &second_station});
+            }
+            else
             {
-                // Build first station on the first available space
-                if(first_station_tile == INVALID_TILE && tile_provides_passengers(*iterator))
-                {
-                    first_station_tile = *iterator;
-                    first_station_offset = offset;
-                    continue;
-                }
-
-                // Build road depot on the next available space
-                if(road_depot_tile == INVALID_TILE)
-                {
-                    road_depot_tile = *iterator;
-                    road_depot_offset = offset;
-                    continue;
-                }
-
-                // Build second station on the last available space
-                if(tile_provides_passengers(*iterator))
-                {
-                    second_station_tile = *iterator;
-                    second_station_offset = offset;
-                }
+                find_site(*front, false, road_depot, {&first_station, &second_station});
             }
+
+            front++;
+            front_position++;
+        }
+
+        if(!second_station.settled && front_position < back_position)
+        {
+            back--;
+            back_position--;
+            find_site(*back, true, second_station, {&first_station, &road_depot});
         }
     }
 
     // If any of the stations can't be built, don't build any of them
-    if(first_station_tile == INVALID_TILE ||
-        road_depot_tile == INVALID_TILE ||
-        second_station_tile == INVALID_TILE)
+    if(!first_station.found || !road_depot.found || !second_station.found)
     {
+        Metrics::count(Metrics::STATIONS_FAILED);
         return false;
     }
 
-    // Build roads, stations, and depot. Note that return values aren't checked since
-    // can_build_road_building() and can_build_road() were called previously
-    EmpireAI::build_bus_station(first_station_tile + first_station_offset, first_station_tile);
-    EmpireAI::build_road(first_station_tile + first_station_offset, first_station_tile);
-    EmpireAI::build_bus_station(second_station_tile + second_station_offset, second_station_tile);
-    EmpireAI::build_road(second_station_tile + second_station_offset, second_station_tile);
-    EmpireAI::build_road_depot(road_depot_tile + road_depot_offset, road_depot_tile);
-    EmpireAI::build_road(road_depot_tile + road_depot_offset, road_depot_tile);
+    // Every item has been checked while searching for its site
+    ConstructionPlan plan;
+    plan.add_item(first_station.building);
+    plan.add_item(first_station.road);
+    plan.add_item(second_station.building);
+    plan.add_item(second_station.road);
+    plan.add_item(road_depot.building);
+    plan.add_item(road_depot.road);
+
+    const bool built = plan.build();
+    Metrics::count(built ? Metrics::STATIONS_BUILT : Metrics::STATIONS_FAILED);
+
+    return built;
+}
+
+
+/// Look for a site for a building next to a tile of the path.
+/**
+ * Cheap checks rule out most neighbours before any command is tested. Station sites are ranked by the passenger
+ * production in their catchment area, and only sites that beat the best site found so far are considered. The
+ * remaining neighbours are checked in a single test-mode scope, best first. A tile already chosen for one of the
+ * other sites is skipped, since the sites of the other buildings can still change while this one is searched for.
+ * @param[in] path_tile The tile of the path to look next to.
+ * @param[in] bus_station True to look for a bus station site, false for a road depot site.
+ * @param[in,out] site The best site found so far, replaced if a better one is found.
+ * @param[in] other_sites The sites of the other buildings, found or not.
+ */
+void RoadStationBuilder::find_site(const TileIndex path_tile, const bool bus_station, Site& site,
+                                   const std::array<const Site*, 2>& other_sites)
+{
+    PassengerMap* passenger_map = PassengerMap::instance();
+
+    std::array<std::pair<uint32, TileIndex>, 4> buildings;
+    size_t building_count = 0;
+
+    for(const TileIndex offset : m_offsets)
+    {
+        const TileIndex building_tile = path_tile + offset;
+
+        if(!tile_is_buildable(building_tile) || site_is_taken(building_tile, other_sites))
+        {
+            continue;
+        }
+
+        uint32 production = 0;
+
+        // A station is only worth building if it collects more passengers than the best site so far
+        if(bus_station)
+        {
+            production = passenger_map->production(building_tile, PassengerMap::BUS_STATION_RADIUS);
+
+            if(production == 0 || production <= site.production)
+            {
+                continue;
+            }
+        }
+
+        // Keep the candidates in order as they are added, best first
+        const std::pair<uint32, TileIndex> building(production, building_tile);
+        size_t position = building_count++;
+
+        while(position > 0 && buildings[position - 1] < building)
+        {
+            buildings[position] = buildings[position - 1];
+            position--;
+        }
+
+        buildings[position] = building;
+    }
+
+    ConstructionPlan candidates;
+
+    for(size_t index = 0; index < building_count; index++)
+    {
+        if(bus_station)
+        {
+            candidates.add_bus_station(buildings[index].second, path_tile);
+        }
+        else
+        {
+            candidates.add_road_depot(buildings[index].second, path_tile);
+        }
+
+        candidates.add_road(buildings[index].second, path_tile);
+    }
+
+    if(candidates.size() > 0)
+    {
+        candidates.check();
+    }
+
+    for(size_t index = 0; index < candidates.size(); index += 2)
+    {
+        if(candidates.item(index).feasible && candidates.item(index + 1).feasible)
+        {
+            // Give a station a few more tiles to find a better site
+            if(!site.found)
+            {
+                site.tiles_left = bus_station ? STATION_SEARCH_LENGTH : 0;
+            }
+
+            site.found = true;
+            site.production = buildings[index / 2].first;
+            site.building = candidates.item(index);
+            site.road = candidates.item(index + 1);
+            break;
+        }
+    }
+
+    if(site.found)
+    {
+        if(site.tiles_left == 0)
+        {
+            site.settled = true;
+        }
+        else
+        {
+            site.tiles_left--;
+        }
+    }
+}
+
+
+/// Check whether a tile has been chosen for the building of another site.
+/**
+ * @param[in] tile The tile to check.
+ * @param[in] other_sites The sites of the other buildings, found or not.
+ * @return True if one of the sites that has been found builds on the tile.
+ */
+bool RoadStationBuilder::site_is_taken(const TileIndex tile, const std::array<const Site*, 2>& other_sites)
+{
+    for(const Site* other_site : other_sites)
+    {
+        if(other_site->found && other_site->building.tile_index == tile)
+        {
+            return true;
+        }
+    }
 
-    return true;
+    return false;
 }
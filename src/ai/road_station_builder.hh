@@ -1,8 +1,11 @@
 #ifndef ROAD_STATION_BUILDER_HH
 #define ROAD_STATION_BUILDER_HH
 
+#include "construction_plan.hh"
 #include "path.hh"
 
+#include <array>
+
 namespace EmpireAI
 {
     /**
@@ -18,7 +21,29 @@ namespace EmpireAI
 
     private:
 
+        /**
+         * A site next to the path for a building, checked together with the road connecting it to the path.
+         */
+        struct Site
+        {
+            bool found = false;     ///< True once a site that can be built has been found.
+            bool settled = false;   ///< True once no better site will be looked for.
+            uint32 production = 0;  ///< Passenger production in the catchment area of a station site.
+            uint32 tiles_left = 0;  ///< Path tiles still to scan for a better site, once a site has been found.
+            ConstructionPlan::Item building;
+            ConstructionPlan::Item road;
+        };
+
+        /// Path tiles scanned for a better station site after the first one is found
+        static const uint32 STATION_SEARCH_LENGTH = 8;
+
+        void find_site(const TileIndex path_tile, const bool bus_station, Site& site,
+                       const std::array<const Site*, 2>& other_sites);
+        static bool site_is_taken(const TileIndex tile, const std::array<const Site*, 2>& other_sites);
+
         Path& m_path;
+
+        std::array<TileIndex, 4> m_offsets; ///< Offsets from a path tile to its four neighbours.
     };
 }
 
@@ -0,0 +1,157 @@
+/// \file
+#ifndef SAVE_BUFFER_HH
+#define SAVE_BUFFER_HH
+
+
+#include "stdafx.h"
+#include "tile_type.h"
+#include "map_func.h"
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Bytes of the AI's work in progress, written for the savegame.
+     *
+     * Values are written little endian whatever the platform, so that a game saved on one machine can be loaded on
+     * another. The savegame only sees the finished buffer, so the format is entirely up to the AI.
+     */
+    class SaveWriter
+    {
+    public:
+
+        void write_uint8(const uint8 value)
+        {
+            m_data.push_back(value);
+        }
+
+        void write_uint16(const uint16 value)
+        {
+            write_uint8((uint8)value);
+            write_uint8((uint8)(value >> 8));
+        }
+
+        void write_uint32(const uint32 value)
+        {
+            write_uint16((uint16)value);
+            write_uint16((uint16)(value >> 16));
+        }
+
+        /// Write a list of tiles, preceded by its length.
+        void write_tiles(const std::vector<TileIndex>& tiles)
+        {
+            write_uint32((uint32)tiles.size());
+
+            for(const TileIndex tile : tiles)
+            {
+                write_uint32(tile);
+            }
+        }
+
+        const std::vector<uint8>& data() const
+        {
+            return m_data;
+        }
+
+    private:
+
+        std::vector<uint8> m_data;
+    };
+
+
+    /**
+     * Reads back the bytes written by a SaveWriter.
+     *
+     * A savegame may be truncated or come from another version of the AI, so nothing read is trusted. Once a read
+     * runs past the end of the data, or a value turns out to be invalid, the reader fails and every later read
+     * returns 0. The caller checks failed() once it has read everything, and starts over if it is set.
+     */
+    class SaveReader
+    {
+    public:
+
+        SaveReader(const std::vector<uint8>& data)
+        : m_data(data), m_position(0), m_failed(false)
+        {}
+
+        uint8 read_uint8()
+        {
+            if(m_failed || m_position == m_data.size())
+            {
+                m_failed = true;
+                return 0;
+            }
+
+            return m_data[m_position++];
+        }
+
+        uint16 read_uint16()
+        {
+            const uint16 low = read_uint8();
+            return low | (uint16)(read_uint8() << 8);
+        }
+
+        uint32 read_uint32()
+        {
+            const uint32 low = read_uint16();
+            return low | ((uint32)read_uint16() << 16);
+        }
+
+        /// Read a tile, which must lie on the current map.
+        TileIndex read_tile()
+        {
+            const TileIndex tile = read_uint32();
+
+            if(tile >= MapSize())
+            {
+                fail();
+                return 0;
+            }
+
+            return tile;
+        }
+
+        /// Read a list of tiles written by SaveWriter::write_tiles().
+        void read_tiles(std::vector<TileIndex>& tiles)
+        {
+            const uint32 count = read_uint32();
+            tiles.clear();
+
+            // Don't let a corrupt length allocate more than the data could possibly hold
+            if(count > (m_data.size() - m_position) / sizeof(uint32))
+            {
+                fail();
+                return;
+            }
+
+            tiles.reserve(count);
+
+            for(uint32 index = 0; index < count && !m_failed; index++)
+            {
+                tiles.push_back(read_tile());
+            }
+        }
+
+        /// Mark the data as invalid, for values that can be read but make no sense.
+        void fail()
+        {
+            m_failed = true;
+        }
+
+        /// Return true if the data was incomplete or invalid.
+        bool failed() const
+        {
+            return m_failed;
+        }
+
+    private:
+
+        const std::vector<uint8>& m_data;
+        size_t m_position;
+        bool m_failed;
+    };
+}
+
+
+#endif // SAVE_BUFFER_HH
@@ -0,0 +1,74 @@
+/// \file
+#include "shared_map_caches.hh"
+#include "cluster_map.hh"
+#include "connectivity_cache.hh"
+#include "landmark_map.hh"
+#include "node_store.hh"
+#include "passenger_map.hh"
+
+using namespace EmpireAI;
+
+
+std::weak_ptr<SharedMapCaches> SharedMapCaches::m_instance;
+
+
+SharedMapCaches::SharedMapCaches()
+: m_refreshed(false), m_refresh_tick(0)
+{
+}
+
+
+/// Free the caches, and the nodes pooled for searches, once the last AI that used them has gone.
+SharedMapCaches::~SharedMapCaches()
+{
+    // The cluster map reads the connectivity cache, so it goes first
+    ClusterMap::destroy();
+    ConnectivityCache::destroy();
+    LandmarkMap::destroy();
+    PassengerMap::destroy();
+
+    // The memory kept for the next search isn't needed either
+    NodeStore::free_pool();
+}
+
+
+/// Get a reference to the caches shared by every AI, creating them if no AI holds a reference yet.
+/**
+ * Must be called on the game thread.
+ * @return The shared caches, which stay alive as long as any reference to them does.
+ */
+std::shared_ptr<SharedMapCaches> SharedMapCaches::acquire()
+{
+    std::shared_ptr<SharedMapCaches> caches = m_instance.lock();
+
+    if(caches == nullptr)
+    {
+        caches.reset(new SharedMapCaches());
+        m_instance = caches;
+    }
+
+    return caches;
+}
+
+
+/// Carry on rebuilding the caches that follow the map in the background.
+/**
+ * Every AI calls this each tick, but the work is only done by the first call of a tick, so it doesn't grow
+ * with the number of AIs.
+ * @param[in] tick The current game tick.
+ */
+void SharedMapCaches::refresh(const uint32 tick)
+{
+    if(m_refreshed && tick == m_refresh_tick)
+    {
+        return;
+    }
+
+    m_refreshed = true;
+    m_refresh_tick = tick;
+
+    // Changed tiles are cleared from the other caches as well, so this goes first
+    ConnectivityCache::instance()->refresh(CONNECTIVITY_CACHE_TILES_PER_TICK);
+    PassengerMap::instance()->refresh(PASSENGER_MAP_TILES_PER_TICK);
+    LandmarkMap::instance()->refresh(LANDMARK_MAP_TILES_PER_TICK);
+}
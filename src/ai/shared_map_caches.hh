@@ -0,0 +1,59 @@
+/// \file
+#ifndef SHARED_MAP_CACHES_HH
+#define SHARED_MAP_CACHES_HH
+
+
+#include "stdafx.h"
+#include <memory>
+
+
+namespace EmpireAI
+{
+    /**
+     * Owner of the caches of map data that every EmpireAI company in the game shares.
+     *
+     * The ConnectivityCache, ClusterMap, LandmarkMap and PassengerMap describe the map, not a company, so one copy
+     * of each serves every AI. Each AI holds a reference from acquire() for as long as it runs, and the caches are
+     * freed once the last AI has gone. Memory therefore stays the same however many AIs run, and an AI that starts
+     * later finds the caches already warm. Changes to the map reach every cache through MapChangeListener, so they
+     * are invalidated in one place.
+     *
+     * The caches are filled in as they are read, so they may only be used from the game thread, where OpenTTD runs
+     * the AIs one after another. They aren't safe for concurrent readers, so worker threads never see them. The
+     * search of an AsyncPath reads the map through SnapshotMapAccess, which only holds its own MapSnapshot, and
+     * takes its heuristic from LandmarkTables. Neither changes once built, so any number of threads can read them.
+     */
+    class SharedMapCaches
+    {
+    public:
+
+        ~SharedMapCaches();
+        SharedMapCaches(const SharedMapCaches&) = delete;
+        SharedMapCaches& operator=(const SharedMapCaches&) = delete;
+
+        static std::shared_ptr<SharedMapCaches> acquire();
+
+        void refresh(const uint32 tick);
+
+    private:
+
+        SharedMapCaches();
+
+        /// Tiles of the PassengerMap rescanned per tick, so that it follows the growth of towns
+        static const uint32 PASSENGER_MAP_TILES_PER_TICK = 1024;
+
+        /// Tiles of the ConnectivityCache checked per tick, so that it follows changes made by others
+        static const uint32 CONNECTIVITY_CACHE_TILES_PER_TICK = 1024;
+
+        /// Tiles of the LandmarkMap searched from per tick while it is being built
+        static const uint32 LANDMARK_MAP_TILES_PER_TICK = 4096;
+
+        static std::weak_ptr<SharedMapCaches> m_instance;
+
+        bool m_refreshed;       ///< True once the caches have been refreshed at least once.
+        uint32 m_refresh_tick;  ///< The game tick of the last refresh.
+    };
+}
+
+
+#endif // SHARED_MAP_CACHES_HH
@@ -0,0 +1,192 @@
+/// \file
+#ifndef TASK_HH
+#define TASK_HH
+
+
+#include "stdafx.h"
+#include <coroutine>
+#include <exception>
+#include <type_traits>
+#include <utility>
+
+
+namespace EmpireAI
+{
+    /**
+     * Parts of the promise of a Task that don't depend on its result.
+     *
+     * A task starts suspended, and only runs once it is awaited or resumed. When it finishes, it resumes the
+     * coroutine that awaited it directly, without going through the caller of resume(), so a chain of nested tasks
+     * costs no stack however often it is suspended and resumed.
+     */
+    class TaskPromiseBase
+    {
+    public:
+
+        /// Resumes the awaiting coroutine, if any, once the task has finished.
+        class FinalAwaiter
+        {
+        public:
+
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            template <typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                const std::coroutine_handle<> continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        FinalAwaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        /// The AI doesn't throw, so anything thrown is a bug that can't be recovered from.
+        void unhandled_exception()
+        {
+            std::terminate();
+        }
+
+        std::coroutine_handle<> continuation; ///< The coroutine awaiting this task, or none for a top-level task.
+    };
+
+
+    /// Promise of a Task that returns a value.
+    template <typename T>
+    class TaskPromise : public TaskPromiseBase
+    {
+    public:
+
+        void return_value(T new_value)
+        {
+            value = std::move(new_value);
+        }
+
+        T value{};
+    };
+
+
+    /// Promise of a Task that returns nothing.
+    template <>
+    class TaskPromise<void> : public TaskPromiseBase
+    {
+    public:
+
+        void return_void() {}
+    };
+
+
+    /**
+     * A coroutine that does some work of the AI, spread over as many game ticks as it needs.
+     *
+     * A task is awaited by the task that started it, with co_await, and returns its result to it. A top-level task
+     * is resumed by whoever owns it, see DecisionEngine. The task owns its coroutine, and destroys it along with
+     * every task it is awaiting.
+     */
+    template <typename T = void>
+    class Task
+    {
+    public:
+
+        class promise_type : public TaskPromise<T>
+        {
+        public:
+
+            Task get_return_object()
+            {
+                return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+        };
+
+        Task()
+        : m_handle(nullptr)
+        {}
+
+        Task(Task&& other) noexcept
+        : m_handle(std::exchange(other.m_handle, nullptr))
+        {}
+
+        Task& operator=(Task&& other) noexcept
+        {
+            if(this != &other)
+            {
+                destroy();
+                m_handle = std::exchange(other.m_handle, nullptr);
+            }
+
+            return *this;
+        }
+
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+        ~Task()
+        {
+            destroy();
+        }
+
+        /// The point to resume a top-level task from the first time.
+        std::coroutine_handle<> handle() const
+        {
+            return m_handle;
+        }
+
+        /// Return true once the task has returned, or if there is no task.
+        bool done() const
+        {
+            return !m_handle || m_handle.done();
+        }
+
+        bool await_ready() const noexcept
+        {
+            return false;
+        }
+
+        /// Start the task, and resume the awaiting coroutine once it has finished.
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<> continuation) noexcept
+        {
+            m_handle.promise().continuation = continuation;
+            return m_handle;
+        }
+
+        T await_resume()
+        {
+            if constexpr(!std::is_void_v<T>)
+            {
+                return std::move(m_handle.promise().value);
+            }
+        }
+
+    private:
+
+        explicit Task(std::coroutine_handle<promise_type> handle)
+        : m_handle(handle)
+        {}
+
+        void destroy()
+        {
+            if(m_handle)
+            {
+                m_handle.destroy();
+                m_handle = nullptr;
+            }
+        }
+
+        std::coroutine_handle<promise_type> m_handle;
+    };
+}
+
+
+#endif // TASK_HH
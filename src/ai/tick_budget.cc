@@ -0,0 +1,38 @@
+/// \file
+#include "tick_budget.hh"
+
+#include <algorithm>
+
+using namespace EmpireAI;
+
+
+TickBudget::TickBudget()
+: m_budget_us(INITIAL_BUDGET_US), m_average_interval_us(TICK_DURATION_US), m_started(false)
+{
+}
+
+
+/// Start timing a new tick, adapting the budget to how long the previous tick took to arrive.
+void TickBudget::start_tick()
+{
+    const Clock::time_point now = Clock::now();
+    const int64 interval_us = std::chrono::duration_cast<std::chrono::microseconds>(now - m_tick_start).count();
+
+    if(m_started && interval_us < PAUSE_US)
+    {
+        // Single late ticks are common even on an idle server, so only react to the average
+        m_average_interval_us += (interval_us - m_average_interval_us) / 8;
+
+        if(m_average_interval_us > LATE_TICK_US)
+        {
+            m_budget_us = std::max(MIN_BUDGET_US, m_budget_us / 2);
+        }
+        else
+        {
+            m_budget_us = std::min(MAX_BUDGET_US, m_budget_us + m_budget_us / 16 + 1);
+        }
+    }
+
+    m_started = true;
+    m_tick_start = now;
+}
@@ -0,0 +1,66 @@
+/// \file
+#ifndef TICK_BUDGET_HH
+#define TICK_BUDGET_HH
+
+
+#include "stdafx.h"
+#include <chrono>
+
+
+namespace EmpireAI
+{
+    /**
+     * Wall-clock time the AI may spend in one game tick.
+     *
+     * The budget adapts to how well the game keeps up. OpenTTD measures the time of each AI in its
+     * PerformanceMeasurer (PFE_AI0 + company), but doesn't let anyone read it back, so the budget is
+     * adapted from the time between the starts of two ticks instead, averaged over the last few ticks. While
+     * ticks arrive on time the budget grows slowly, and while they arrive late it is halved every tick.
+     */
+    class TickBudget
+    {
+    public:
+
+        TickBudget();
+
+        void start_tick();
+
+        /// Return true once the time of the current tick is used up.
+        bool exhausted() const
+        {
+            return elapsed_us() >= m_budget_us;
+        }
+
+        /// Return the time the AI may use per tick, in microseconds.
+        int64 budget_us() const
+        {
+            return m_budget_us;
+        }
+
+        /// Return the time since the start of the current tick, in microseconds.
+        int64 elapsed_us() const
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - m_tick_start).count();
+        }
+
+    private:
+
+        typedef std::chrono::steady_clock Clock;
+
+        static const int64 TICK_DURATION_US = 30000; ///< Length of a game tick at normal game speed.
+        static const int64 LATE_TICK_US = TICK_DURATION_US + TICK_DURATION_US / 16; ///< Later than this, the game can't keep up.
+        static const int64 PAUSE_US = 1000000; ///< Longer gaps are pauses, saving or loading, which say nothing about load.
+
+        static const int64 MIN_BUDGET_US = 250;
+        static const int64 MAX_BUDGET_US = TICK_DURATION_US / 3;
+        static const int64 INITIAL_BUDGET_US = 2000;
+
+        int64 m_budget_us;
+        int64 m_average_interval_us; ///< Moving average of the time between the starts of two ticks.
+        bool m_started;
+        Clock::time_point m_tick_start;
+    };
+}
+
+
+#endif // TICK_BUDGET_HH
@@ -0,0 +1,212 @@
+/// \file
+#include "town_index.hh"
+
+#include "date_func.h"
+#include "map_func.h"
+#include "town.h"
+
+#include <algorithm>
+
+using namespace EmpireAI;
+
+
+TownIndex::TownIndex()
+: m_cells_per_row(0), m_cell_rows(0), m_refresh_date(0), m_town_count(0)
+{
+}
+
+
+/// Find every town within a distance of a tile.
+/**
+ * Only the cells of the grid that overlap the area are searched.
+ * @param[in] tile The tile to measure distances from.
+ * @param[in] radius The maximum Manhattan distance from the tile to a town.
+ * @param[out] towns The towns found, largest first.
+ */
+void TownIndex::towns_in_radius(const TileIndex tile, const uint32 radius, std::vector<const Entry*>& towns) const
+{
+    towns.clear();
+
+    const uint32 first_cell_x = (TileX(tile) - std::min(TileX(tile), radius)) >> CELL_BITS;
+    const uint32 first_cell_y = (TileY(tile) - std::min(TileY(tile), radius)) >> CELL_BITS;
+    const uint32 last_cell_x = std::min(TileX(tile) + radius, MapMaxX()) >> CELL_BITS;
+    const uint32 last_cell_y = std::min(TileY(tile) + radius, MapMaxY()) >> CELL_BITS;
+
+    std::vector<uint32> town_indices;
+
+    for(uint32 cell_y = first_cell_y; cell_y <= last_cell_y; cell_y++)
+    {
+        for(uint32 cell_x = first_cell_x; cell_x <= last_cell_x; cell_x++)
+        {
+            for(const uint32 town_index : m_cells[cell_y * m_cells_per_row + cell_x])
+            {
+                if(DistanceManhattan(tile, m_towns[town_index].location) <= radius)
+                {
+                    town_indices.push_back(town_index);
+                }
+            }
+        }
+    }
+
+    // The towns are stored largest first, so sorting the indices keeps that order
+    std::sort(town_indices.begin(), town_indices.end());
+
+    for(const uint32 town_index : town_indices)
+    {
+        towns.push_back(&m_towns[town_index]);
+    }
+}
+
+
+/// Choose two towns to connect with a new route.
+/**
+ * The source is the largest town that isn't connected yet and has a partner in range. The destination is the town
+ * in range with the most population per tile of road, whether it is connected already or not. Routes that are in
+ * progress, or have been tried since the last refresh, are skipped.
+ * @param[out] source The town to start the route from.
+ * @param[out] destination The town to end the route at.
+ * @return True if a route was found.
+ */
+bool TownIndex::choose_route(TownID& source, TownID& destination)
+{
+    std::vector<const Entry*> towns;
+
+    for(const Entry& source_town : m_towns)
+    {
+        if(source_town.connected)
+        {
+            continue;
+        }
+
+        towns_in_radius(source_town.location, MAX_ROUTE_DISTANCE, towns);
+
+        const Entry* best_town = nullptr;
+        uint64 best_score = 0;
+
+        for(const Entry* town : towns)
+        {
+            const uint32 distance = DistanceManhattan(source_town.location, town->location);
+
+            const std::pair<TownID, TownID> route(source_town.town_id, town->town_id);
+
+            if(distance < MIN_ROUTE_DISTANCE || m_tried_routes.count(route) > 0 || m_routes_in_progress.count(route) > 0)
+            {
+                continue;
+            }
+
+            const uint64 score = ((uint64)town->population << 16) / distance;
+
+            if(best_town == nullptr || score > best_score)
+            {
+                best_town = town;
+                best_score = score;
+            }
+        }
+
+        if(best_town != nullptr)
+        {
+            source = source_town.town_id;
+            destination = best_town->town_id;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/// Remember that we have built stations in a town.
+void TownIndex::set_connected(const TownID town_id)
+{
+    m_connected_towns.insert(town_id);
+
+    for(Entry& town : m_towns)
+    {
+        if(town.town_id == town_id)
+        {
+            town.connected = true;
+        }
+    }
+}
+
+
+/// Remember that a route has been attempted, so that choose_route() doesn't pick it again until the next refresh.
+void TownIndex::set_tried(const TownID source, const TownID destination)
+{
+    m_tried_routes.insert(std::make_pair(source, destination));
+    m_tried_routes.insert(std::make_pair(destination, source));
+}
+
+
+/// Remember that a route is being worked on, so that choose_route() doesn't pick it again until end_route().
+void TownIndex::start_route(const TownID source, const TownID destination)
+{
+    m_routes_in_progress.insert(std::make_pair(source, destination));
+    m_routes_in_progress.insert(std::make_pair(destination, source));
+}
+
+
+/// Forget that a route is being worked on, once it has been finished, has failed or has been dropped.
+void TownIndex::end_route(const TownID source, const TownID destination)
+{
+    m_routes_in_progress.erase(std::make_pair(source, destination));
+    m_routes_in_progress.erase(std::make_pair(destination, source));
+}
+
+
+/// Refresh the index if it is out of date, and forget everything if a new game has been started.
+void TownIndex::refresh_if_needed()
+{
+    // The date only goes backwards, or the map changes size, when another game is loaded
+    const bool new_game = _date < m_refresh_date || m_cells_per_row != (MapSizeX() >> CELL_BITS) ||
+        m_cell_rows != (MapSizeY() >> CELL_BITS);
+
+    if(new_game)
+    {
+        m_connected_towns.clear();
+    }
+
+    if(new_game || _date >= m_refresh_date + REFRESH_DAYS || m_town_count != ::Town::GetNumItems())
+    {
+        refresh();
+    }
+}
+
+
+/// Rebuild the list of towns and the grid from the current map.
+void TownIndex::refresh()
+{
+    m_towns.clear();
+
+    for(const ::Town* town : ::Town::Iterate())
+    {
+        Entry entry;
+        entry.town_id = town->index;
+        entry.location = town->xy;
+        entry.population = town->cache.population;
+        entry.connected = m_connected_towns.count(town->index) > 0;
+
+        m_towns.push_back(entry);
+    }
+
+    std::sort(m_towns.begin(), m_towns.end(), [](const Entry& a, const Entry& b) { return a.population > b.population; });
+
+    // Every map dimension is a multiple of the cell size
+    m_cells_per_row = MapSizeX() >> CELL_BITS;
+    m_cell_rows = MapSizeY() >> CELL_BITS;
+
+    m_cells.clear();
+    m_cells.resize(m_cells_per_row * m_cell_rows);
+
+    for(uint32 town_index = 0; town_index < m_towns.size(); town_index++)
+    {
+        const TileIndex location = m_towns[town_index].location;
+        m_cells[(TileY(location) >> CELL_BITS) * m_cells_per_row + (TileX(location) >> CELL_BITS)].push_back(town_index);
+    }
+
+    // Routes that failed before may work now that the map has moved on
+    m_tried_routes.clear();
+
+    m_refresh_date = _date;
+    m_town_count = ::Town::GetNumItems();
+}
@@ -0,0 +1,85 @@
+/// \file
+#ifndef TOWN_INDEX_HH
+#define TOWN_INDEX_HH
+
+
+#include "stdafx.h"
+#include "date_type.h"
+#include "tile_type.h"
+#include "town_type.h"
+#include <set>
+#include <utility>
+#include <vector>
+
+
+namespace EmpireAI
+{
+    /**
+     * Cached list of the towns on the map, with a uniform grid for finding the towns around a tile.
+     *
+     * For each town the location and population are kept, along with whether we have already connected it.
+     * The list is refreshed every 30 days, or as soon as the number of towns changes. Route selection uses
+     * the index to pick the largest town that isn't connected yet, and the best partner for it nearby,
+     * instead of picking towns at random. Each AI keeps its own index, since it knows which towns that AI has
+     * connected.
+     */
+    class TownIndex
+    {
+    public:
+
+        /**
+         * What the index knows about one town.
+         */
+        struct Entry
+        {
+            TownID town_id;
+            TileIndex location;
+            uint32 population;
+            bool connected; ///< True once we have built stations in this town.
+        };
+
+        TownIndex();
+
+        void refresh_if_needed();
+
+        void towns_in_radius(const TileIndex tile, const uint32 radius, std::vector<const Entry*>& towns) const;
+
+        bool choose_route(TownID& source, TownID& destination);
+
+        void set_connected(const TownID town_id);
+        void set_tried(const TownID source, const TownID destination);
+        void start_route(const TownID source, const TownID destination);
+        void end_route(const TownID source, const TownID destination);
+
+    private:
+
+        void refresh();
+
+        /// Routes shorter than this carry too few passengers to be worth a road
+        static const uint32 MIN_ROUTE_DISTANCE = 20;
+        /// Routes longer than this take too long to search for and to build
+        static const uint32 MAX_ROUTE_DISTANCE = 150;
+
+        /// The list is refreshed after this many days
+        static const Date REFRESH_DAYS = 30;
+
+        /// Cells of the grid are CELL_SIZE x CELL_SIZE tiles
+        static const uint32 CELL_BITS = 6;
+        static const uint32 CELL_SIZE = 1 << CELL_BITS;
+
+        std::vector<Entry> m_towns;                    ///< Every town, largest first.
+        std::vector<std::vector<uint32>> m_cells;      ///< Indices into m_towns of the towns in each cell.
+        uint32 m_cells_per_row;
+        uint32 m_cell_rows;
+
+        std::set<TownID> m_connected_towns;            ///< Kept across refreshes, since the list is rebuilt from scratch.
+        std::set<std::pair<TownID, TownID>> m_tried_routes; ///< Routes attempted since the last refresh.
+        std::set<std::pair<TownID, TownID>> m_routes_in_progress; ///< Kept across refreshes, until the route ends.
+
+        Date m_refresh_date; ///< The date of the last refresh.
+        uint32 m_town_count; ///< The number of towns at the last refresh.
+    };
+}
+
+
+#endif // TOWN_INDEX_HH